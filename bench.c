@@ -0,0 +1,593 @@
+#undef NDEBUG
+
+#define _DEFAULT_SOURCE 1
+
+#include<assert.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+
+#include"jsb.h"
+
+/*
+ * Converts deterministic synthetic corpora both ways and prints one line per
+ * measurement: a record type, then tab-separated key=value fields. Times are
+ * medians of REPS runs after WARMUP runs; cpb is timestamp counter ticks per
+ * input byte (0 where there is no such counter).
+ *
+ * usage:
+ *  bench [corpus megabytes, default 16]
+ *  bench trav - read side (traversal API) latencies instead
+ */
+
+#define COUNT(array) (sizeof(array) / sizeof(*array))
+
+#define WARMUP 2
+#define REPS 9
+
+/* deterministic pseudo-random numbers */
+static uint32_t rnd(uint64_t *s){
+	*s = *s * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+	return *s >> 33;
+}
+
+static double now(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t ticks(void){
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/* mixed records of numbers, strings, and small containers */
+static size_t gen_mixed(char *dst, size_t len, uint64_t seed, size_t *docs){
+	static const char *words[] = { "alpha", "beta", "gamma", "delta \\\"quoted\\\"", "caf\xc3\xa9", "\\u00e9t\\u00e9" };
+	size_t n = 0, i;
+	n += sprintf(dst + n, "[");
+	while(n + 256 < len){
+		n += sprintf(dst + n, "%s{\"id\":%u,\"name\":\"%s\",\"score\":%d.%02u,\"ok\":%s,\"tags\":[",
+			n > 1 ? "," : "", rnd(&seed), words[rnd(&seed) % COUNT(words)],
+			(int)(rnd(&seed) % 2000) - 1000, rnd(&seed) % 100, rnd(&seed) & 1 ? "true" : "false");
+		for(i = rnd(&seed) % 4; i; i--)
+			n += sprintf(dst + n, "\"%s\"%s", words[rnd(&seed) % COUNT(words)], i > 1 ? "," : "");
+		n += sprintf(dst + n, "],\"pos\":[%u.%u,-%u.%ue-3],\"extra\":null}", rnd(&seed) % 180, rnd(&seed), rnd(&seed) % 90, rnd(&seed));
+	}
+	n += sprintf(dst + n, "]");
+	*docs = 1;
+	return n;
+}
+
+/* one feature collection of polygons - mostly numbers */
+static size_t gen_geojson(char *dst, size_t len, uint64_t seed, size_t *docs){
+	size_t n = 0, i, f = 0;
+	n += sprintf(dst + n, "{\"type\":\"FeatureCollection\",\"features\":[");
+	while(n + 4096 < len){
+		n += sprintf(dst + n, "%s{\"type\":\"Feature\",\"properties\":{\"id\":%lu,\"area\":%u.%u},\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[[",
+			f ? "," : "", (unsigned long)f, rnd(&seed) % 10000, rnd(&seed) % 1000);
+		for(i = 4 + rnd(&seed) % 60; i; i--)
+			n += sprintf(dst + n, "[-%u.%06u,%u.%06u]%s", 70 + rnd(&seed) % 50, rnd(&seed) % 1000000, 25 + rnd(&seed) % 24, rnd(&seed) % 1000000, i > 1 ? "," : "");
+		n += sprintf(dst + n, "]]}}");
+		f++;
+	}
+	n += sprintf(dst + n, "]}");
+	*docs = 1;
+	return n;
+}
+
+/* array of log records - mostly ascii strings with occasional escapes */
+static size_t gen_logs(char *dst, size_t len, uint64_t seed, size_t *docs){
+	static const char *levels[] = { "DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR" };
+	static const char *paths[] = { "/api/v1/items", "/api/v1/users/search", "/static/app.js", "/login?next=%2Fhome" };
+	size_t n = 0, r = 0;
+	n += sprintf(dst + n, "[");
+	while(n + 1024 < len){
+		n += sprintf(dst + n, "%s{\"ts\":\"2024-%02u-%02uT%02u:%02u:%02u.%03uZ\",\"level\":\"%s\",\"host\":\"web-%02u\","
+			"\"msg\":\"GET %s/%u HTTP/1.1 %u \\\"Mozilla/5.0 (X11; Linux x86_64)\\\" took %ums\\tuser=\\\\u%u\","
+			"\"trace\":\"%08x%08x\"}",
+			r ? "," : "", 1 + rnd(&seed) % 12, 1 + rnd(&seed) % 28, rnd(&seed) % 24, rnd(&seed) % 60, rnd(&seed) % 60, rnd(&seed) % 1000,
+			levels[rnd(&seed) % COUNT(levels)], rnd(&seed) % 32, paths[rnd(&seed) % COUNT(paths)], rnd(&seed),
+			200 + rnd(&seed) % 4 * 100, rnd(&seed) % 5000, rnd(&seed) % 100000, rnd(&seed), rnd(&seed));
+		r++;
+	}
+	n += sprintf(dst + n, "]");
+	*docs = 1;
+	return n;
+}
+
+/* array of strings in several scripts, raw and escaped */
+static size_t gen_unicode(char *dst, size_t len, uint64_t seed, size_t *docs){
+	static const char *words[] = {
+		"\xce\xba\xce\xb1\xce\xbb\xce\xb7\xce\xbc\xce\xad\xcf\x81\xce\xb1",
+		"\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82",
+		"\xe4\xbd\xa0\xe5\xa5\xbd\xe4\xb8\x96\xe7\x95\x8c",
+		"\xe3\x81\x93\xe3\x82\x93\xe3\x81\xab\xe3\x81\xa1\xe3\x81\xaf",
+		"\xf0\x9f\x98\x80\xf0\x9f\x8e\x89",
+		"\\u00fcber",
+		"\\ud83d\\ude00",
+		"na\\u00efve caf\xc3\xa9"
+	};
+	size_t n = 0, i, s = 0;
+	n += sprintf(dst + n, "[");
+	while(n + 512 < len){
+		n += sprintf(dst + n, "%s\"", s ? "," : "");
+		for(i = 1 + rnd(&seed) % 12; i; i--)
+			n += sprintf(dst + n, "%s%s", words[rnd(&seed) % COUNT(words)], i > 1 ? " " : "");
+		n += sprintf(dst + n, "\"");
+		s++;
+	}
+	n += sprintf(dst + n, "]");
+	*docs = 1;
+	return n;
+}
+
+/* array of alternately nested objects and arrays, close to the default depth limit */
+static size_t gen_deep(char *dst, size_t len, uint64_t seed, size_t *docs){
+	size_t n = 0, d, depth, k = 0;
+	n += sprintf(dst + n, "[");
+	while(n + 1024 < len){
+		depth = 20 + rnd(&seed) % 11;
+		n += sprintf(dst + n, "%s", k++ ? "," : "");
+		for(d = 0; d < depth; d++)
+			n += sprintf(dst + n, "{\"k%lu\":[%u,", (unsigned long)d, rnd(&seed) % 100);
+		n += sprintf(dst + n, "null");
+		for(d = 0; d < depth; d++)
+			n += sprintf(dst + n, "]}");
+	}
+	n += sprintf(dst + n, "]");
+	*docs = 1;
+	return n;
+}
+
+/* array of objects with hundreds of keys each */
+static size_t gen_wide(char *dst, size_t len, uint64_t seed, size_t *docs){
+	size_t n = 0, i, o = 0;
+	n += sprintf(dst + n, "[");
+	while(n + 16384 < len){
+		n += sprintf(dst + n, "%s{", o++ ? "," : "");
+		for(i = 0; i < 512; i++){
+			if(rnd(&seed) & 1)
+				n += sprintf(dst + n, "%s\"field_%03lu\":%u", i ? "," : "", (unsigned long)i, rnd(&seed) % 100000);
+			else
+				n += sprintf(dst + n, "%s\"field_%03lu\":\"v%x\"", i ? "," : "", (unsigned long)i, rnd(&seed));
+		}
+		n += sprintf(dst + n, "}");
+	}
+	n += sprintf(dst + n, "]");
+	*docs = 1;
+	return n;
+}
+
+/* newline-delimited small records */
+static size_t gen_ndjson(char *dst, size_t len, uint64_t seed, size_t *docs){
+	size_t n = 0;
+	*docs = 0;
+	while(n + 256 < len){
+		n += sprintf(dst + n, "{\"id\":%u,\"user\":\"u%u\",\"event\":\"%s\",\"value\":%d.%02u,\"tags\":[\"a\",\"b%u\"],\"ok\":%s}\n",
+			rnd(&seed), rnd(&seed) % 10000, rnd(&seed) & 1 ? "click" : "view",
+			(int)(rnd(&seed) % 2000) - 1000, rnd(&seed) % 100, rnd(&seed) % 10, rnd(&seed) & 1 ? "true" : "false");
+		++*docs;
+	}
+	return n;
+}
+
+/* convert src, feeding chunk bytes of input per jsb_update() call, returning elapsed seconds */
+static double stream(uint8_t *dst, size_t dstlen, const void *src, size_t srclen, size_t chunk, uint32_t flags, size_t *outlen){
+	jsb_t jsb;
+	size_t rv, left = srclen;
+	double t0 = now();
+	jsb_init(&jsb, flags, 0);
+	jsb.next_in = src;
+	jsb.avail_in = 0;
+	jsb.next_out = dst;
+	jsb.avail_out = dstlen;
+	do{
+		if(!jsb.avail_in){
+			jsb.avail_in = left < chunk ? left : chunk;
+			left -= jsb.avail_in;
+			if(!left)
+				jsb_eof(&jsb);
+		}
+		rv = jsb_update(&jsb);
+	}while(JSB_OK == rv && jsb.avail_out);
+	assert(JSB_DONE == rv);
+	*outlen = jsb.total_out;
+	return now() - t0;
+}
+
+static int cmp_double(const void *a, const void *b){
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* median seconds (and counter ticks) of REPS runs, after WARMUP */
+static double median(uint8_t *dst, size_t dstlen, const void *src, size_t srclen, size_t chunk, uint32_t flags, size_t *outlen, double *tk){
+	double t[REPS], c[REPS];
+	uint64_t c0;
+	int i;
+	for(i = 0; i < WARMUP; i++)
+		stream(dst, dstlen, src, srclen, chunk, flags, outlen);
+	for(i = 0; i < REPS; i++){
+		c0 = ticks();
+		t[i] = stream(dst, dstlen, src, srclen, chunk, flags, outlen);
+		c[i] = ticks() - c0;
+	}
+	qsort(t, REPS, sizeof(*t), cmp_double);
+	qsort(c, REPS, sizeof(*c), cmp_double);
+	if(tk)
+		*tk = c[REPS / 2];
+	return t[REPS / 2];
+}
+
+static void bench_corpus(const char *name, const char *json, size_t len, size_t docs, uint32_t flags){
+	uint8_t *bin = malloc(2 * len + 2), *txt = malloc(2 * len + 2);
+	size_t blen, tlen;
+	double f, r, fc, rc;
+	assert(bin && txt);
+	f = median(bin, 2 * len + 2, json, len, len, flags, &blen, &fc);
+	r = median(txt, 2 * len + 2, bin, blen, blen, flags | JSB_REVERSE, &tlen, &rc);
+	printf("corpus\tname=%s\tbytes=%lu\tbin_bytes=%lu\tdocs=%lu"
+		"\tfwd_mbps=%.1f\tfwd_ns_doc=%.0f\tfwd_cpb=%.2f"
+		"\trev_mbps=%.1f\trev_ns_doc=%.0f\trev_cpb=%.2f\n",
+		name, (unsigned long)len, (unsigned long)blen, (unsigned long)docs,
+		len / f / 1048576, f * 1e9 / docs, fc / len,
+		blen / r / 1048576, r * 1e9 / docs, rc / blen);
+	free(bin);
+	free(txt);
+}
+
+static void bench_stream(const char *json, size_t len){
+	static const size_t chunks[] = { 0, 65536, 4096, 1536, 512, 64 };
+	uint8_t *bin = malloc(len + 2), *txt = malloc(len * 2);
+	size_t blen, tlen, i;
+	double fbase = 0, rbase = 0, f, r;
+	assert(bin && txt);
+	for(i = 0; i < COUNT(chunks); i++){
+		f = median(bin, len + 2, json, len, chunks[i] ? chunks[i] : len, 0, &blen, NULL);
+		r = median((uint8_t *)txt, len * 2, bin, blen, chunks[i] ? chunks[i] : blen, JSB_REVERSE, &tlen, NULL);
+		if(!chunks[i]){
+			fbase = f;
+			rbase = r;
+		}
+		printf("stream\tchunk=%lu\tfwd_mbps=%.1f\tfwd_rel=%.3f\trev_mbps=%.1f\trev_rel=%.3f\n", (unsigned long)chunks[i],
+			len / f / 1048576, fbase / f, blen / r / 1048576, rbase / r);
+	}
+	free(bin);
+	free(txt);
+}
+
+/*
+ * Traversal benchmarks: each op runs in batches sized to a few microseconds,
+ * and per-op latency percentiles are taken over the batches.
+ */
+
+#define NARGS 1024
+#define MAXKEYS 4096
+
+typedef struct {
+	const uint8_t *bin;
+	const size_t *meta;
+	size_t *wmeta, n, m;
+	size_t root, depth, off0, off1;
+	size_t args[NARGS];
+	const char *keys[MAXKEYS];
+	size_t klen[MAXKEYS];
+	size_t *keyinfo, *offsets;
+} trav_t;
+
+static volatile size_t trav_sink;
+
+static void lat(const char *fields, size_t (*op)(trav_t *t, size_t i), trav_t *t){
+	static double s[1000];
+	size_t i, j, batch, samples, acc = 0;
+	double t0, one;
+	for(i = 0; i < 8; i++)
+		acc += op(t, i);
+	t0 = now();
+	acc += op(t, 0);
+	one = (now() - t0) * 1e9;
+	batch = one >= 2000 ? 1 : one < 30 ? 64 : 2000 / one;
+	samples = 5e7 / (one * batch + 1);
+	samples = samples < 25 ? 25 : samples > COUNT(s) ? COUNT(s) : samples;
+	for(i = 0; i < samples; i++){
+		t0 = now();
+		for(j = 0; j < batch; j++)
+			acc += op(t, i * batch + j);
+		s[i] = (now() - t0) * 1e9 / batch;
+	}
+	trav_sink = acc;
+	qsort(s, samples, sizeof(*s), cmp_double);
+	printf("trav\t%s\tp50_ns=%.1f\tp90_ns=%.1f\tp99_ns=%.1f\tmax_ns=%.1f\n",
+		fields, s[samples / 2], s[samples * 9 / 10], s[samples * 99 / 100], s[samples - 1]);
+}
+
+static size_t op_obj_get(trav_t *t, size_t i){
+	size_t a = t->args[i % NARGS];
+	return jsb_obj_get(t->bin, t->root, t->meta, t->keys[a], t->klen[a]);
+}
+
+static size_t op_arr_get(trav_t *t, size_t i){
+	return jsb_arr_get(t->bin, t->root, t->meta, t->args[i % NARGS]);
+}
+
+/* fetch a field from a random array element */
+static size_t op_elem_get(trav_t *t, size_t i){
+	size_t off = jsb_arr_get(t->bin, t->root, t->meta, t->args[i % NARGS]);
+	return jsb_obj_get(t->bin, off, t->meta, "name", 4);
+}
+
+/* descend through depth levels, taking the last item of each */
+static size_t op_path(trav_t *t, size_t i){
+	size_t d, off = t->root;
+	(void)i;
+	for(d = 0; d < t->depth; d++)
+		if(!(off = jsb_arr_get(t->bin, off, t->meta, 3)))
+			break;
+	return off;
+}
+
+static size_t op_size(trav_t *t, size_t i){
+	(void)i;
+	return jsb_size(t->bin, t->root, t->meta);
+}
+
+static size_t op_count(trav_t *t, size_t i){
+	(void)i;
+	return jsb_count(t->bin, t->root, t->meta);
+}
+
+static size_t op_analyze(trav_t *t, size_t i){
+	(void)i;
+	return jsb_analyze(t->bin, t->root, t->wmeta, t->n, t->m);
+}
+
+static size_t op_match(trav_t *t, size_t i){
+	(void)i;
+	return jsb_match(t->bin, t->root, t->meta, t->keys, t->keyinfo, t->offsets);
+}
+
+static size_t op_cmp(trav_t *t, size_t i){
+	(void)i;
+	return jsb_cmp(t->bin, t->off0, t->bin, t->off1);
+}
+
+/* convert generated json into the shared binary buffer */
+static void trav_load(trav_t *t, uint8_t *bin, size_t cap, const char *json, size_t len){
+	size_t blen = jsb(bin, cap, json, len, 0, -1);
+	assert(JSB_ERROR != blen);
+	t->bin = bin;
+	t->meta = NULL;
+	t->root = 0;
+}
+
+static void trav_args(trav_t *t, size_t range, uint64_t *seed){
+	size_t i;
+	for(i = 0; i < NARGS; i++)
+		t->args[i] = rnd(seed) % range;
+}
+
+static void bench_trav(void){
+	static const size_t widths[] = { 4, 16, 64, 256, 1024 };
+	static const size_t lengths[] = { 16, 256, 4096, 65536 };
+	static const size_t depths[] = { 1, 8, 32, 60 };
+	static const size_t budgets[] = { 0, 48, 768, 12288, 49152 };
+	static const size_t mins[] = { 0, 256 };
+	static const size_t nkeys[] = { 1, 4, 16 };
+	static const char *shapes[] = { "k%lu", "a_fairly_long_common_attribute_prefix_%lu" };
+	static const char *vals[] = { "%lu", "[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31,%lu]" };
+	static const char *cmps[][2] = {
+		{ "12345", "12346" },
+		{ "1234567890123456789012345678901234567890", "1234567890123456789012345678901234567891" },
+		{ "1.5e10", "15e9" },
+		{ "-0.000001234", "-1.234e-6" }
+	};
+	static trav_t t;
+	size_t cap = 1<<25, len, i, j, k, s, v, d, b, mi, klen = 0;
+	char *json = malloc(cap), *kpool = malloc(MAXKEYS * 64), fields[128];
+	uint8_t *bin = malloc(cap + 2);
+	size_t *meta = malloc(sizeof(*meta) * 49152), keyinfo[2 * 16 + 1], offsets[16];
+	uint64_t seed = 1;
+	assert(json && kpool && bin && meta);
+
+	/* obj_get by width, key shape, hit/miss, and scalar vs. nested values (with and without a full index) */
+	for(s = 0; s < COUNT(shapes); s++){
+		for(i = 0, klen = 0; i < MAXKEYS; i++){
+			t.keys[i] = kpool + klen;
+			t.klen[i] = sprintf(kpool + klen, shapes[s], (unsigned long)i);
+			klen += t.klen[i] + 1;
+		}
+		for(v = 0; v < COUNT(vals); v++){
+			for(i = 0; i < COUNT(widths); i++){
+				len = sprintf(json, "{");
+				for(j = 0; j < widths[i]; j++){
+					len += sprintf(json + len, "%s\"", j ? "," : "");
+					len += sprintf(json + len, shapes[s], (unsigned long)j);
+					len += sprintf(json + len, "\":");
+					len += sprintf(json + len, vals[v], (unsigned long)j);
+				}
+				len += sprintf(json + len, "}");
+				trav_load(&t, bin, cap + 2, json, len);
+				for(k = 0; k < 2; k++){
+					trav_args(&t, widths[i], &seed);
+					if(k)
+						for(j = 0; j < NARGS; j++)
+							t.args[j] += widths[i];
+					for(mi = 0; mi < 2; mi++){
+						t.meta = mi ? meta : NULL;
+						if(mi)
+							jsb_analyze(bin, 0, meta, 3 * (widths[i] + 2), 0);
+						sprintf(fields, "op=obj_get\twidth=%lu\tkeys=%s\tvalues=%s\taccess=%s\tmeta=%d",
+							(unsigned long)widths[i], s ? "prefix" : "short", v ? "nested" : "scalar", k ? "miss" : "hit", (int)mi);
+						lat(fields, op_obj_get, &t);
+					}
+				}
+			}
+		}
+	}
+
+	/* match a few keys at once from a 64 key object */
+	len = sprintf(json, "{");
+	for(j = 0; j < 64; j++)
+		len += sprintf(json + len, "%s\"k%lu\":%lu", j ? "," : "", (unsigned long)j, (unsigned long)j);
+	len += sprintf(json + len, "}");
+	trav_load(&t, bin, cap + 2, json, len);
+	for(i = 0, klen = 0; i < 16; i++){
+		t.keys[i] = kpool + klen;
+		t.klen[i] = sprintf(kpool + klen, "k%lu", (unsigned long)(i * 4 + 3));
+		klen += t.klen[i] + 1;
+	}
+	for(i = 0; i < COUNT(nkeys); i++){
+		keyinfo[0] = nkeys[i];
+		for(j = 0; j < nkeys[i]; j++)
+			keyinfo[1 + j] = t.klen[j];
+		jsb_prepare(keyinfo, t.keys, 0);
+		t.keyinfo = keyinfo;
+		t.offsets = offsets;
+		sprintf(fields, "op=match\twidth=64\tkeys=%lu", (unsigned long)nkeys[i]);
+		lat(fields, op_match, &t);
+	}
+
+	/* arr_get by length, for scalar and object elements */
+	for(v = 0; v < 2; v++){
+		for(i = 0; i < COUNT(lengths); i++){
+			len = sprintf(json, "[");
+			for(j = 0; j < lengths[i]; j++){
+				if(v)
+					len += sprintf(json + len, "%s{\"id\":%lu,\"name\":\"n%lu\",\"xy\":[%u,%u]}", j ? "," : "", (unsigned long)j, (unsigned long)j, rnd(&seed) % 1000, rnd(&seed) % 1000);
+				else
+					len += sprintf(json + len, "%s%lu", j ? "," : "", (unsigned long)j);
+			}
+			len += sprintf(json + len, "]");
+			trav_load(&t, bin, cap + 2, json, len);
+			trav_args(&t, lengths[i], &seed);
+			sprintf(fields, "op=arr_get\tlength=%lu\tvalues=%s\tmeta=0", (unsigned long)lengths[i], v ? "object" : "scalar");
+			lat(fields, op_arr_get, &t);
+		}
+	}
+
+	/* size, count, and a root to leaf walk by nesting depth */
+	for(i = 0; i < COUNT(depths); i++){
+		len = 0;
+		for(d = 0; d < depths[i]; d++)
+			len += sprintf(json + len, "[\"a\",%lu,true,", (unsigned long)d);
+		len += sprintf(json + len, "null");
+		for(d = 0; d < depths[i]; d++)
+			len += sprintf(json + len, "]");
+		trav_load(&t, bin, cap + 2, json, len);
+		t.depth = depths[i] - 1;
+		for(mi = 0; mi < 2; mi++){
+			t.meta = mi ? meta : NULL;
+			if(mi)
+				jsb_analyze(bin, 0, meta, 3 * (depths[i] + 2), 0);
+			sprintf(fields, "op=size\tdepth=%lu\tmeta=%d", (unsigned long)depths[i], (int)mi);
+			lat(fields, op_size, &t);
+			sprintf(fields, "op=count\tdepth=%lu\tmeta=%d", (unsigned long)depths[i], (int)mi);
+			lat(fields, op_count, &t);
+			sprintf(fields, "op=path\tdepth=%lu\tmeta=%d", (unsigned long)depths[i], (int)mi);
+			lat(fields, op_path, &t);
+		}
+	}
+
+	/* index budget (n) and minimum indexed size (m) over an array of 4096 records */
+	len = sprintf(json, "[");
+	for(j = 0; j < 4096; j++){
+		len += sprintf(json + len, "%s{\"id\":%lu,\"tags\":[", j ? "," : "", (unsigned long)j);
+		for(k = 0; k < 16; k++)
+			len += sprintf(json + len, "%s%u", k ? "," : "", rnd(&seed) % 100000);
+		len += sprintf(json + len, "],\"name\":\"record %lu\"}", (unsigned long)j);
+	}
+	len += sprintf(json + len, "]");
+	trav_load(&t, bin, cap + 2, json, len);
+	trav_args(&t, 4096, &seed);
+	t.wmeta = meta;
+	for(b = 0; b < COUNT(budgets); b++){
+		for(mi = 0; mi < COUNT(mins); mi++){
+			if(!budgets[b] && mi)
+				continue;
+			t.n = budgets[b];
+			t.m = mins[mi];
+			t.meta = NULL;
+			if(t.n){
+				sprintf(fields, "op=analyze\tn=%lu\tm=%lu", (unsigned long)t.n, (unsigned long)t.m);
+				lat(fields, op_analyze, &t);
+				jsb_analyze(bin, 0, meta, t.n, t.m);
+				t.meta = meta;
+			}
+			sprintf(fields, "op=arr_get\tlength=4096\tvalues=record\tn=%lu\tm=%lu", (unsigned long)t.n, (unsigned long)t.m);
+			lat(fields, op_arr_get, &t);
+			sprintf(fields, "op=elem_get\tlength=4096\tn=%lu\tm=%lu", (unsigned long)t.n, (unsigned long)t.m);
+			lat(fields, op_elem_get, &t);
+			sprintf(fields, "op=size\tlength=4096\tn=%lu\tm=%lu", (unsigned long)t.n, (unsigned long)t.m);
+			lat(fields, op_size, &t);
+			sprintf(fields, "op=count\tlength=4096\tn=%lu\tm=%lu", (unsigned long)t.n, (unsigned long)t.m);
+			lat(fields, op_count, &t);
+		}
+	}
+
+	/* scalar comparisons: numbers of various forms, then strings of growing length */
+	t.meta = NULL;
+	for(i = 0; i < COUNT(cmps); i++){
+		len = sprintf(json, "[%s,%s]", cmps[i][0], cmps[i][1]);
+		trav_load(&t, bin, cap + 2, json, len);
+		t.off0 = jsb_arr_get(bin, 0, NULL, 0);
+		t.off1 = jsb_arr_get(bin, 0, NULL, 1);
+		sprintf(fields, "op=cmp\ttype=number\ta=%s\tb=%s", cmps[i][0], cmps[i][1]);
+		lat(fields, op_cmp, &t);
+	}
+	for(i = 8; i <= 4096; i *= 8){
+		len = sprintf(json, "[\"");
+		memset(json + len, 'x', i);
+		len += sprintf(json + len + i, "a\",\"") + i;
+		memset(json + len, 'x', i);
+		len += sprintf(json + len + i, "b\"]") + i;
+		trav_load(&t, bin, cap + 2, json, len);
+		t.off0 = jsb_arr_get(bin, 0, NULL, 0);
+		t.off1 = jsb_arr_get(bin, 0, NULL, 1);
+		sprintf(fields, "op=cmp\ttype=string\tlength=%lu", (unsigned long)i + 1);
+		lat(fields, op_cmp, &t);
+	}
+
+	free(meta);
+	free(bin);
+	free(kpool);
+	free(json);
+}
+
+int main(int argc, char **argv){
+	static const struct {
+		const char *name;
+		size_t (*gen)(char *dst, size_t len, uint64_t seed, size_t *docs);
+		uint32_t flags;
+	} corpora[] = {
+		{ "mixed", gen_mixed, 0 },
+		{ "geojson", gen_geojson, 0 },
+		{ "logs", gen_logs, 0 },
+		{ "unicode", gen_unicode, 0 },
+		{ "deep", gen_deep, 0 },
+		{ "wide", gen_wide, 0 },
+		{ "ndjson", gen_ndjson, JSB_LINES }
+	};
+	size_t cap, len, docs, i;
+	char *json;
+	if(argc > 1 && !strcmp(argv[1], "trav")){
+		bench_trav();
+		return 0;
+	}
+	cap = (argc > 1 ? strtoul(argv[1], NULL, 0) : 16) << 20;
+	json = malloc(cap);
+	assert(json && cap);
+	for(i = 0; i < COUNT(corpora); i++){
+		len = corpora[i].gen(json, cap, 1, &docs);
+		bench_corpus(corpora[i].name, json, len, docs, corpora[i].flags);
+	}
+	len = gen_mixed(json, cap, 1, &docs);
+	bench_stream(json, len);
+	free(json);
+	return 0;
+}
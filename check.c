@@ -2,6 +2,7 @@
 
 #include<assert.h>
 #include<string.h>
+#include<stdlib.h>
 #include<stdio.h>
 
 #include"jsb.h"
@@ -84,6 +85,144 @@ static size_t cpy(void *dst, const void *src){
 
 #define COUNT(array) (sizeof(array) / sizeof(*array))
 
+typedef struct {
+	char *num;
+	double f64;
+	int64_t i64;
+	size_t f64_r;
+	size_t i64_r;
+} numchk_t;
+
+numchk_t nums[] = {
+	{ "0",                      0.0,                     0,                  JSB_EXACT,   JSB_EXACT   },
+	{ "-0",                     -0.0,                    0,                  JSB_EXACT,   JSB_EXACT   },
+	{ "1.5e1",                  15.0,                    15,                 JSB_EXACT,   JSB_EXACT   },
+	{ "-2.5",                   -2.5,                    -2,                 JSB_EXACT,   JSB_INEXACT },
+	{ "0.1",                    0.1,                     0,                  JSB_INEXACT, JSB_INEXACT },
+	{ "9007199254740993",       9007199254740992.0,      INT64_C(9007199254740993), JSB_INEXACT, JSB_EXACT   },
+	{ "-9223372036854775809",   -9223372036854775808.0,  INT64_MIN,          JSB_INEXACT, JSB_INEXACT },
+	{ "1e400",                  1e300 * 1e300,           INT64_MAX,          JSB_INEXACT, JSB_INEXACT },
+	{ "2.4703282292062328e-324", 4.9406564584124654e-324, 0,                 JSB_INEXACT, JSB_INEXACT },
+	{ "8.67361737988403547205962240695953369140625e-19", 8.67361737988403547205962240695953369140625e-19, 0, JSB_EXACT, JSB_INEXACT },
+};
+
+static void chk_num(void){
+	const int nnums = sizeof(nums) / sizeof(*nums);
+	uint8_t bin[256];
+	uint64_t u64;
+	int64_t i64;
+	double f64;
+	int i;
+	for(i = 0; i < nnums; i++){
+		assert(jsb(bin, sizeof(bin), nums[i].num, strlen(nums[i].num), 0, -1) != JSB_ERROR);
+		assert(jsb_num_f64(bin, 0, &f64) == nums[i].f64_r);
+		assert(memcmp(&f64, &nums[i].f64, sizeof(f64)) == 0);
+		assert(jsb_num_i64(bin, 0, &i64) == nums[i].i64_r);
+		assert(i64 == nums[i].i64);
+	}
+	jsb(bin, sizeof(bin), "18446744073709551615", 20, 0, -1);
+	assert(jsb_num_u64(bin, 0, &u64) == JSB_EXACT && u64 == UINT64_MAX);
+	jsb(bin, sizeof(bin), "-1", 2, 0, -1);
+	assert(jsb_num_u64(bin, 0, &u64) == JSB_INEXACT && u64 == 0);
+	jsb(bin, sizeof(bin), "true", 4, 0, -1);
+	assert(jsb_num_f64(bin, 0, &f64) == JSB_ERROR);
+}
+
+typedef struct {
+	double f64;
+	char *num;
+} fmtchk_t;
+
+fmtchk_t fmts[] = {
+	{ 0.0,                     "0"                       },
+	{ -0.0,                    "-0"                      },
+	{ 0.1,                     "0.1"                     },
+	{ -1.5,                    "-1.5"                    },
+	{ 1e21,                    "1e21"                    },
+	{ 123e18,                  "123000000000000000000"   },
+	{ 1e-7,                    "1e-7"                    },
+	{ 9.9e-7,                  "9.9e-7"                  },
+	{ 0.000001,                "0.000001"                },
+	{ 5e-324,                  "5e-324"                  },
+	{ 1.7976931348623157e308,  "1.7976931348623157e308"  },
+	{ 2.225073858507201e-308,  "2.225073858507201e-308"  },
+};
+
+static void chk_fmt(void){
+	const int nfmts = sizeof(fmts) / sizeof(*fmts);
+	uint8_t bin[JSB_FMT_MAX];
+	double f64;
+	size_t len;
+	int i;
+	for(i = 0; i < nfmts; i++){
+		len = jsb_fmt_f64(bin, fmts[i].f64);
+		assert(len == strlen(fmts[i].num) + 1);
+		assert(bin[0] == JSB_NUM && memcmp(bin + 1, fmts[i].num, len - 1) == 0);
+		bin[len] = JSB_DOC_END;
+		assert(jsb_num_f64(bin, 0, &f64) != JSB_ERROR);
+		assert(memcmp(&f64, &fmts[i].f64, sizeof(f64)) == 0);
+	}
+	assert(jsb_fmt_f64(bin, 1e300 * 1e300) == JSB_ERROR);
+	len = jsb_fmt_i64(bin, INT64_MIN);
+	assert(len == 21 && memcmp(bin + 1, "-9223372036854775808", 20) == 0);
+	len = jsb_fmt_u64(bin, 0);
+	assert(len == 2 && bin[1] == '0');
+}
+
+/* feed writer output one byte at a time */
+static size_t chk_drain(jsb_w_t *w, size_t r){
+	while(!w->avail_out){
+		w->avail_out = 1;
+		jsb_w_flush(w);
+	}
+	return r;
+}
+
+static void chk_writer(void){
+	const char json[] = "{\"k\":[1,\"s\",null,{}],\"f\":0.5}";
+	uint8_t ref[64], bin[64];
+	size_t meta0[32], meta1[32];
+	size_t i, len = jsb(ref, sizeof(ref), json, sizeof(json) - 1, 0, -1);
+	jsb_w_t w;
+	assert(jsb_w_init(&w, JSB_VALIDATE, sizeof(w)) == JSB_DEFAULT_DEPTH);
+	w.next_out = bin;
+	w.avail_out = sizeof(bin);
+	assert(jsb_w_key(&w, "k", 1) == JSB_ERROR);
+	assert(jsb_w_obj(&w) == JSB_OK);
+	assert(jsb_w_end(&w) == JSB_DONE);
+	assert(jsb_w_obj(&w) == JSB_ERROR);
+
+	/* now write one byte at a time */
+	jsb_w_init(&w, JSB_VALIDATE, 0);
+	w.next_out = bin;
+	w.avail_out = 1;
+	assert(jsb_w_index(&w, meta1, 32, 0) == JSB_OK);
+	assert(chk_drain(&w, jsb_w_obj(&w)) == JSB_OK);
+	assert(jsb_w_str(&w, "k", 1) == JSB_ERROR);
+	assert(jsb_w_key(&w, "k", 1) == JSB_OK);
+	/* held output must be flushed first */
+	assert(jsb_w_arr(&w) == JSB_ERROR);
+	chk_drain(&w, 0);
+	assert(chk_drain(&w, jsb_w_arr(&w)) == JSB_OK);
+	assert(chk_drain(&w, jsb_w_u64(&w, 1)) == JSB_OK);
+	assert(chk_drain(&w, jsb_w_str(&w, "s", 1)) == JSB_OK);
+	assert(chk_drain(&w, jsb_w_null(&w)) == JSB_OK);
+	assert(chk_drain(&w, jsb_w_obj(&w)) == JSB_OK);
+	assert(chk_drain(&w, jsb_w_end(&w)) == JSB_OK);
+	assert(chk_drain(&w, jsb_w_end(&w)) == JSB_OK);
+	assert(jsb_w_key(&w, "\xff", 1) == JSB_ERROR);
+	assert(chk_drain(&w, jsb_w_key(&w, "f", -1)) == JSB_OK);
+	assert(jsb_w_num(&w, "5E-1", 4) == JSB_ERROR);
+	assert(chk_drain(&w, jsb_w_f64(&w, 0.5)) == JSB_OK);
+	assert(chk_drain(&w, jsb_w_end(&w)) == JSB_DONE);
+	assert(w.total_out == len && memcmp(ref, bin, len) == 0);
+
+	/* writer index should match jsb_analyze() */
+	jsb_analyze(bin, 0, meta0, 32, 0);
+	for(i = 0; i < 2 + 3 * meta0[0]; i++)
+		assert(meta0[i] == meta1[i]);
+}
+
 static int chk_match(void){
 	char *keys[] = {"one", "two", "three", "four", "five", "six", "seven", "eight", "nine", "ten" };
 	size_t keyinfo[COUNT(keys) * 2 + 1] = { COUNT(keys) };
@@ -94,7 +233,7 @@ static int chk_match(void){
 
 static void chk_analyze(uint8_t *bin){
 	size_t meta[256];
-	size_t c0, c1, s0, s1;
+	size_t c0, c1, s0, s1, j, k;
 	size_t i, n = jsb_analyze(bin, 0, meta, sizeof(meta)/sizeof(*meta), 0);
 	assert(n <= sizeof(meta)/sizeof(*meta));
 	for(i = 0; bin[i] != JSB_DOC_END; i++){
@@ -106,9 +245,625 @@ static void chk_analyze(uint8_t *bin){
 			c1 = jsb_count(bin, i, meta);
 			assert(c0 == c1);
 		}
+		/* lookups must land in the same place with or without meta */
+		if(bin[i] == JSB_ARR)
+			for(j = 0; j < 8; j++)
+				assert(jsb_arr_get(bin, i, NULL, j) == jsb_arr_get(bin, i, meta, j));
+		if(bin[i] == JSB_OBJ){
+			for(j = 0, k = i + 1; j < 8 && bin[k] == JSB_KEY; j++){
+				s0 = jsb_size(bin, k, NULL);
+				assert(jsb_obj_get(bin, i, NULL, bin + k + 1, s0 - 1) == jsb_obj_get(bin, i, meta, bin + k + 1, s0 - 1));
+				k += s0;
+				k += jsb_size(bin, k, NULL);
+			}
+		}
 	}
 }
 
+typedef struct {
+	uint8_t *out;
+	size_t len;
+	size_t part;
+	size_t stop;
+} evchk_t;
+
+/* reassemble binary from events */
+static size_t chk_event(void *ctx, uint32_t event, const uint8_t *ptr, size_t len){
+	evchk_t *e = ctx;
+	assert((event & 0xff) >= JSB_OBJ && !(event & ~(uint32_t)(JSB_PARTIAL | 0xff)));
+	assert(len || !(event & JSB_PARTIAL));
+	if(!e->part)
+		e->out[e->len++] = event;
+	e->part = event & JSB_PARTIAL;
+	while(len--)
+		e->out[e->len++] = *ptr++;
+	return e->len > e->stop ? JSB_ERROR : JSB_OK;
+}
+
+static size_t chk_events(const char *json, size_t n, size_t chunk, uint32_t flags){
+	uint8_t out[1024], tmp[1024];
+	evchk_t e = { NULL, 0, 0, (size_t)-1 };
+	size_t len = strlen(json), rv;
+	jsb_t j;
+	e.out = out;
+	jsb_init(&j, flags, 0);
+	assert(jsb_events(&j, chk_event, &e, tmp, n) == JSB_OK);
+	j.next_in = (const void *)json;
+	j.avail_in = 0;
+	j.next_out = NULL;
+	j.avail_out = 0;
+	do{
+		if(!j.avail_in){
+			if(len){
+				j.avail_in = len < chunk ? len : chunk;
+				len -= j.avail_in;
+			}else
+				jsb_eof(&j);
+		}
+		rv = jsb_update(&j);
+	}while(JSB_OK == rv);
+	assert(!j.next_out && !j.avail_out);
+	if(JSB_DONE != rv)
+		return rv;
+	assert(j.total_out == e.len && !e.part);
+	assert(jsb(tmp, sizeof(tmp), json, strlen(json), flags, -1) == e.len);
+	assert(memcmp(tmp, out, e.len) == 0);
+	/* aborting from the callback */
+	e.len = 0;
+	e.stop = 2;
+	jsb_init(&j, flags | JSB_EOF, 0);
+	jsb_events(&j, chk_event, &e, tmp, n);
+	j.next_in = (const void *)json;
+	j.avail_in = strlen(json);
+	assert(jsb_update(&j) == (e.len > e.stop ? JSB_ERROR : JSB_DONE));
+	if(e.len > e.stop)
+		assert(jsb_update(&j) == JSB_ERROR);
+	return JSB_DONE;
+}
+
+/* limit work per call, checking output is unaffected */
+static void chk_budget(const void *src, size_t len, uint32_t flags){
+	uint8_t out[1024], ref[1024];
+	size_t n = jsb(ref, sizeof(ref), src, len, flags, -1), rv, in, done;
+	jsb_t j;
+	jsb_init(&j, flags | JSB_EOF, 0);
+	j.next_in = src;
+	j.avail_in = len;
+	j.next_out = out;
+	j.avail_out = sizeof(out);
+	j.budget_in = 3;
+	j.budget_out = 2;
+	do{
+		in = j.total_in;
+		done = j.total_out;
+		rv = jsb_update(&j);
+		assert(j.total_in - in <= 3 && j.total_out - done <= 2);
+	}while(JSB_OK == rv);
+	assert(JSB_DONE == rv && !j.avail_in && j.total_out == n);
+	assert(memcmp(out, ref, n) == 0);
+}
+
+/* batch results should match individual conversions */
+static void chk_batch(void){
+	jsb_batch_t items[COUNT(pass) + 3];
+	uint8_t out[COUNT(items)][64], ref[64];
+	size_t i, n = COUNT(pass);
+	for(i = 0; i < COUNT(items); i++){
+		items[i].src = i < n ? pass[i] : "[1,]";
+		items[i].srclen = strlen(items[i].src);
+		items[i].dst = out[i];
+		items[i].dstlen = i <= n ? sizeof(*out) : 2;
+	}
+	items[n + 1].src = pass[n - 1];
+	items[n + 1].srclen = strlen(pass[n - 1]);
+	/* a good item after failed ones gets a fresh parser */
+	items[n + 2].src = pass[n - 1];
+	items[n + 2].srclen = strlen(pass[n - 1]);
+	items[n + 2].dstlen = sizeof(*out);
+	assert(jsb_batch(items, COUNT(items), 0, -1) == n + 1);
+	for(i = 0; i < n; i++){
+		assert(items[i].ret == jsb(ref, sizeof(ref), pass[i], strlen(pass[i]), 0, -1));
+		assert(memcmp(ref, out[i], items[i].ret) == 0);
+	}
+	assert(items[n].ret == JSB_ERROR && items[n + 1].ret == JSB_ERROR);
+	assert(items[n + 2].ret == items[n - 1].ret && memcmp(out[n + 2], out[n - 1], items[n - 1].ret) == 0);
+}
+
+/* compare the first two items of a json array */
+static int chk_cmp1(const char *json){
+	uint8_t bin[256];
+	assert(jsb(bin, sizeof(bin), json, strlen(json), 0, -1) != JSB_ERROR);
+	return jsb_cmp(bin, jsb_arr_get(bin, 0, NULL, 0), bin, jsb_arr_get(bin, 0, NULL, 1));
+}
+
+static void chk_cmp(void){
+	assert(chk_cmp1("[\"abc\",\"abd\"]") == -1);
+	assert(chk_cmp1("[\"abd\",\"abc\"]") == 3);
+	assert(chk_cmp1("[\"abc\",\"abc\"]") == 1);
+	assert(chk_cmp1("[\"ab\",\"abc\"]") == -1);
+	assert(chk_cmp1("[\"abc\",\"ab\"]") == 3);
+	assert(chk_cmp1("[\"\",\"\"]") == 1);
+	assert(chk_cmp1("[\"\",\"a\"]") == -1);
+	assert(chk_cmp1("[\"x\",[\"x\"]]") == 0);
+	assert(chk_cmp1("[\"x\",1]") == 0);
+	assert(chk_cmp1("[1.5e10,15e9]") == 1);
+	assert(chk_cmp1("[12345,12346]") == -1);
+	assert(chk_cmp1("[true,false]") == 3);
+	assert(chk_cmp1("[null,null]") == 1);
+}
+
+/* sizes and counts should match a bytewise walk at every alignment and length, reading
+ * nothing past the end of the binary - with record bounds known, words are scanned whole
+ */
+static void chk_words(void){
+	static const char text[] = "ab\xc3\xa9" "cdefg\xe2\x82\xac" "hijklmnop\xf0\x9f\x98\x80" "qrstuvwxyz0123456789";
+	uint8_t buf[128], *tight;
+	size_t at, len, i, n;
+	for(at = 0; at < 16; at++){
+		for(len = 0; len < sizeof(text); len++){
+			/* string, then the same string nested in arrays */
+			buf[at] = JSB_STR;
+			memcpy(buf + at + 1, text, len);
+			buf[at + 1 + len] = JSB_DOC_END;
+			for(i = n = 0; i < len; i++)
+				n += ((uint8_t)text[i] & 0xc0) != 0x80;
+			assert(jsb_size(buf, at, NULL) == len + 1);
+			assert(jsb_count(buf, at, NULL) == n);
+			assert(jsb_size_n(buf, at, at + len + 2, NULL) == len + 1);
+			assert(jsb_count_n(buf, at, at + len + 2, NULL) == n);
+			assert(jsb_size_n(buf, at, at + len + 1, NULL) == 0);
+			assert(jsb_count_n(buf, at, at + len + 1, NULL) == JSB_ERROR);
+			buf[at] = JSB_ARR;
+			buf[at + 1] = JSB_ARR;
+			buf[at + 2] = JSB_STR;
+			memcpy(buf + at + 3, text, len);
+			buf[at + 3 + len] = JSB_ARR_END;
+			buf[at + 4 + len] = JSB_ARR_END;
+			buf[at + 5 + len] = JSB_DOC_END;
+			assert(jsb_size(buf, at, NULL) == len + 5);
+			assert(jsb_count(buf, at, NULL) == 1);
+			assert(jsb_size_n(buf, at, at + len + 5, NULL) == len + 5);
+			assert(jsb_count_n(buf, at, at + len + 5, NULL) == 1);
+			assert(jsb_size_n(buf, at, at + len + 4, NULL) == 0);
+			/* a stray 0xc0 is caught wherever it lands */
+			if(len){
+				buf[at + 3 + len / 2] = 0xc0;
+				assert(jsb_size(buf, at, NULL) == 0);
+				assert(jsb_size_n(buf, at, at + len + 6, NULL) == 0);
+			}
+		}
+	}
+	/* binary allocated to its exact size, and cut short there */
+	for(len = 0; len < sizeof(text); len++){
+		for(i = n = 0; i < len; i++)
+			n += ((uint8_t)text[i] & 0xc0) != 0x80;
+		tight = malloc(len + 4);
+		assert(tight);
+		tight[0] = JSB_ARR;
+		tight[1] = JSB_STR;
+		memcpy(tight + 2, text, len);
+		tight[len + 2] = JSB_ARR_END;
+		tight[len + 3] = JSB_DOC_END;
+		assert(jsb_size(tight, 1, NULL) == len + 1 && jsb_count(tight, 1, NULL) == n);
+		assert(jsb_size_n(tight, 0, len + 4, NULL) == len + 3 && jsb_count_n(tight, 1, len + 4, NULL) == n);
+		for(i = 0; i < len + 3; i++){
+			assert(jsb_size_n(tight, 0, i, NULL) == 0 && jsb_count_n(tight, 0, i, NULL) == JSB_ERROR);
+			assert(i < 2 || jsb_count_n(tight, 1, i, NULL) == JSB_ERROR);
+		}
+		free(tight);
+	}
+}
+
+/* record tables should match a bytewise scan, filled at once or a few entries at a time */
+static void chk_records(void){
+	uint8_t buf[64];
+	size_t ends[32], part[32], len, i, j, n, k, off, r;
+	for(len = 0; len < sizeof(buf); len++){
+		for(i = n = 0; i < len; i++){
+			buf[i] = (i * 7 % 5) ? 'a' : JSB_DOC_END;
+			if(JSB_DOC_END == buf[i])
+				ends[n++] = i + 1;
+		}
+		assert(jsb_records(buf, 0, len, part, 32) == n);
+		assert(!n || !memcmp(ends, part, n * sizeof(*ends)));
+		for(k = 1; k < 4; k++){
+			for(j = off = 0; (r = jsb_records(buf, off, len, part + j, k)); off = part[j - 1])
+				j += r;
+			assert(j == n && (!n || !memcmp(ends, part, n * sizeof(*ends))));
+		}
+		for(i = 0; i < n; i++){
+			off = jsb_record_get(ends, n, i, &r);
+			assert(off + r == ends[i] && JSB_DOC_END == buf[off + r - 1]);
+		}
+		assert(jsb_record_get(ends, n, n, NULL) == JSB_ERROR);
+		/* segments end on record ends, bar the last, which ends at len */
+		for(k = 1; k < 6; k++){
+			r = jsb_split(buf, len, part, k);
+			assert(r >= 1 && r <= k && part[r - 1] == len);
+			for(i = 0; i + 1 < r; i++)
+				assert(part[i] < part[i + 1] && JSB_DOC_END == buf[part[i] - 1]);
+		}
+	}
+}
+
+static void chk_columns(void){
+	static const char json[] =
+		"{\"id\":1,\"user\":{\"name\":\"ann\",\"tags\":[true,\"x\"]},\"v\":2.5}\n"
+		"[1]\n"
+		"{\"v\":-7,\"user\":{\"tags\":[false]},\"id\":1.5}\n"
+		"{\"id\":-9223372036854775808,\"user\":{\"name\":\"\"},\"v\":\"2\"}\n";
+	const char *keys[] = { "id", "user", "v" };
+	size_t keyinfo[2 * COUNT(keys) + 1] = { COUNT(keys), -1, -1, -1 };
+	uint8_t bin[256], valid[5][1];
+	size_t ends[8], offsets[COUNT(keys)], strs[4], lens[4], len, n;
+	int64_t ids[4];
+	double vs[4], fids[4];
+	uint8_t tags[4];
+	jsb_col_t cols[5];
+
+	len = jsb(bin, sizeof(bin), json, sizeof(json) - 1, JSB_LINES, -1);
+	assert(len <= JSB_SIZE_MAX);
+	n = jsb_records(bin, 0, len, ends, 8);
+	assert(n == 4);
+
+	/* paths step through objects and arrays */
+	assert(jsb_path_get(bin, 0, NULL, "user" JSB_KEY_S "tags" JSB_KEY_S "1", -1) == jsb_arr_get(bin, jsb_obj_get(bin, jsb_obj_get(bin, 0, NULL, "user", 4), NULL, "tags", 4), NULL, 1));
+	assert(jsb_path_get(bin, 0, NULL, "", 0) == 0);
+	assert(jsb_path_get(bin, 0, NULL, "user" JSB_KEY_S "tags" JSB_KEY_S "2", -1) == 0);
+	assert(jsb_path_get(bin, 0, NULL, "user" JSB_KEY_S "tags" JSB_KEY_S "x", -1) == 0);
+	assert(jsb_path_get(bin, 0, NULL, "id" JSB_KEY_S "x", -1) == 0);
+
+	jsb_prepare(keyinfo, keys, 0);
+	memset(cols, 0, sizeof(cols));
+	cols[0].key = 0; cols[0].type = JSB_COL_I64; cols[0].data = ids;
+	cols[1].key = 0; cols[1].type = JSB_COL_F64; cols[1].data = fids;
+	cols[2].key = 2; cols[2].type = JSB_COL_F64; cols[2].data = vs;
+	cols[3].key = 1; cols[3].type = JSB_COL_STR; cols[3].data = strs; cols[3].lens = lens;
+	cols[3].path = "name"; cols[3].pathlen = -1;
+	cols[4].key = 1; cols[4].type = JSB_COL_BOOL; cols[4].data = tags;
+	cols[4].path = "tags" JSB_KEY_S "0"; cols[4].pathlen = -1;
+	memset(valid, 0xaa, sizeof(valid));
+	for(n = 0; n < 5; n++)
+		cols[n].valid = valid[n];
+
+	/* as two ranges, the first of none */
+	assert(jsb_columns(bin, ends, 4, 0, 5, NULL, keys, keyinfo, offsets, cols, 5) == JSB_ERROR);
+	assert(jsb_columns(bin, ends, 4, 0, 0, NULL, keys, keyinfo, offsets, cols, 5) == 0);
+	assert(jsb_columns(bin, ends, 4, 0, 4, NULL, keys, keyinfo, offsets, cols, 5) == 4);
+	assert((valid[0][0] & 15) == 9 && ids[0] == 1 && ids[2] == 0 && ids[3] == INT64_MIN);
+	assert((valid[1][0] & 15) == 13 && fids[2] == 1.5 && fids[1] == 0);
+	assert((valid[2][0] & 15) == 5 && vs[0] == 2.5 && vs[2] == -7 && vs[3] == 0);
+	assert((valid[3][0] & 15) == 9 && lens[0] == 3 && !memcmp(bin + strs[0], "ann", 3) && lens[3] == 0 && strs[3]);
+	assert((valid[4][0] & 15) == 5 && tags[0] == 1 && tags[2] == 0);
+}
+
+static void chk_aggregate(void){
+	static const char json[] =
+		"{\"status\":500,\"bytes\":10}\n"
+		"{\"status\":200,\"bytes\":7}\n"
+		"{\"bytes\":-3,\"status\":500}\n"
+		"{\"status\":500}\n"
+		"{\"status\":404,\"bytes\":0.5}\n"
+		"-2\n"
+		"{\"status\":500,\"bytes\":9223372036854775807}\n";
+	static const char vals[] = JSB_NUM_S "500" JSB_DOC_END_S JSB_NUM_S "300" JSB_DOC_END_S;
+	jsb_pred_t pred[2];
+	jsb_agg_t a, b, c;
+	uint8_t bin[256], *tight;
+	size_t len, cuts[3], n, i;
+
+	len = jsb(bin, sizeof(bin), json, sizeof(json) - 1, JSB_LINES, -1);
+	assert(len <= JSB_SIZE_MAX);
+
+	/* every record */
+	memset(&a, 0, sizeof(a));
+	assert(jsb_aggregate(bin, 0, len, NULL, "bytes", -1, NULL, 0, &a) == 7);
+	assert(a.rows == 7 && a.count == 5 && a.inexact);
+	assert(a.min == -3 && a.max == 9223372036854775807.0);
+
+	/* the record itself */
+	memset(&a, 0, sizeof(a));
+	assert(jsb_aggregate(bin, 0, len, NULL, "", 0, NULL, 0, &a) == 7);
+	assert(a.count == 1 && !a.inexact && a.isum == -2 && a.sum == -2);
+
+	/* status == 500, where the int64 sum overflows */
+	memset(pred, 0, sizeof(pred));
+	pred[0].path = "status";
+	pred[0].pathlen = -1;
+	pred[0].op = JSB_PRED_EQ;
+	pred[0].base = vals;
+	memset(&a, 0, sizeof(a));
+	assert(jsb_aggregate(bin, 0, len - 1, NULL, "bytes", -1, pred, 1, &a) == JSB_ERROR);
+	/* nothing past len is read, so a record cut short by an exact-size allocation is an error */
+	for(i = 1; i < len; i++){
+		tight = malloc(i);
+		assert(tight);
+		memcpy(tight, bin, i);
+		memset(&a, 0, sizeof(a));
+		assert((JSB_ERROR == jsb_aggregate(tight, 0, i, NULL, "bytes", -1, pred, 1, &a)) == (JSB_DOC_END != bin[i - 1]));
+		free(tight);
+	}
+	memset(&a, 0, sizeof(a));
+	assert(jsb_aggregate(bin, 0, len, NULL, "bytes", -1, pred, 1, &a) == 7);
+	assert(a.rows == 4 && a.count == 3 && a.inexact && a.isum == 7);
+	assert(a.imin == -3 && a.imax == INT64_MAX);
+
+	/* 300 <= status < 500 */
+	pred[0].op = JSB_PRED_LT;
+	pred[1] = pred[0];
+	pred[1].op = JSB_PRED_GE;
+	pred[1].offset = 5;
+	memset(&a, 0, sizeof(a));
+	assert(jsb_aggregate(bin, 0, len, NULL, "bytes", -1, pred, 2, &a) == 7);
+	assert(a.rows == 1 && a.count == 1 && a.inexact && a.sum == 0.5);
+
+	/* split ranges merge into the same aggregates */
+	memset(&a, 0, sizeof(a));
+	assert(jsb_aggregate(bin, 0, len, NULL, "status", -1, NULL, 0, &a) == 7);
+	assert(a.rows == 7 && a.count == 6 && !a.inexact && a.isum == 2604 && a.imin == 200 && a.imax == 500);
+	n = jsb_split(bin, len, cuts, 3);
+	memset(&b, 0, sizeof(b));
+	for(i = 0; i < n; i++){
+		memset(&c, 0, sizeof(c));
+		jsb_aggregate(bin, i ? cuts[i - 1] : 0, cuts[i], NULL, "status", -1, NULL, 0, &c);
+		jsb_agg_merge(&b, &c);
+	}
+	assert(n > 1 && !memcmp(&a, &b, sizeof(a)));
+	memset(&c, 0, sizeof(c));
+	jsb_agg_merge(&c, &a);
+	jsb_agg_merge(&c, &a);
+	assert(c.rows == 14 && c.isum == 5208 && c.sum == 5208 && c.min == 200 && !c.inexact);
+}
+
+static void chk_filter(void){
+	static const char json[] =
+		"{\"user\":{\"id\":5,\"name\":\"ann\"},\"n\":1}\n"
+		"{\"n\":2,\"user\":{\"id\":6}}\n"
+		"[5,{\"id\":5}]\n"
+		"{\"user\":{\"id\":\"5\"},\"user\":{\"id\":5}}\n"
+		"{\"user\":[5],\"n\":3}\n"
+		"{\"n\":4,\"user\":{\"name\":\"bob\",\"id\":5.0}}\n";
+	static const char vals[] = JSB_NUM_S "5" JSB_DOC_END_S JSB_NUM_S "2" JSB_DOC_END_S;
+	static const struct { const char *path; uint32_t op; size_t val; unsigned expect; } terms[] = {
+		{ "user" JSB_KEY_S "id", JSB_PRED_EQ, 0, 041 },
+		{ "user" JSB_KEY_S "id", JSB_PRED_NE, 0, 012 },
+		{ "user" JSB_KEY_S "name", JSB_PRED_HAS, 0, 041 },
+		{ "user" JSB_KEY_S "0", JSB_PRED_EQ, 0, 020 },
+		{ "0", JSB_PRED_LE, 0, 004 },
+		{ "n", JSB_PRED_GT, 3, 060 },
+		{ "n", JSB_PRED_HAS, 0, 063 },
+		{ "", JSB_PRED_HAS, 0, 077 },
+	};
+	jsb_pred_t pred[COUNT(terms)];
+	jsb_filter_t f;
+	uint8_t bin[512], *tight;
+	size_t len, ends[8], hits[2 * 8], off, n, i, j, k;
+	unsigned got;
+
+	len = jsb(bin, sizeof(bin), json, sizeof(json) - 1, JSB_LINES, -1);
+	assert(len <= JSB_SIZE_MAX);
+	assert(jsb_records(bin, 0, len, ends, 8) == 6);
+	memset(pred, 0, sizeof(pred));
+	for(i = 0; i < COUNT(terms); i++){
+		pred[i].path = terms[i].path;
+		pred[i].pathlen = -1;
+		pred[i].op = terms[i].op;
+		pred[i].base = vals;
+		pred[i].offset = terms[i].val;
+	}
+
+	/* each term alone, then pairs sharing keys or not */
+	for(i = 0; i < COUNT(terms); i++){
+		for(j = i; j < COUNT(terms); j++){
+			jsb_pred_t two[2];
+			two[0] = pred[i];
+			two[1] = pred[j];
+			assert(jsb_pred_compile(&f, two, 2) == JSB_OK);
+			for(got = 0, k = 0; k < 6; k++)
+				got |= jsb_test(&f, bin, k ? ends[k - 1] : 0, NULL) << k;
+			assert(got == (terms[i].expect & terms[j].expect));
+		}
+	}
+
+	/* the first four stored a record (then a pair) at a time */
+	assert(jsb_pred_compile(&f, pred, 1) == JSB_OK);
+	for(k = 1; k < 3; k++){
+		for(off = 0, j = 0; off != len; j += n){
+			n = jsb_filter(&f, bin, &off, len, NULL, hits + 2 * j, k);
+			assert(n <= k);
+		}
+		assert(j == 2 && hits[0] == 0 && hits[1] == ends[0] && hits[2] == ends[4] && hits[3] == ends[5]);
+	}
+	off = 0;
+	assert(jsb_filter(&f, bin, &off, len - 1, NULL, hits, 8) == JSB_ERROR);
+	/* nothing past len is read: whole records pass, and one cut short by an exact-size allocation fails */
+	for(i = 1, k = 0; i < len; i++){
+		tight = malloc(i);
+		assert(tight);
+		memcpy(tight, bin, i);
+		off = 0;
+		n = jsb_filter(&f, tight, &off, i, NULL, hits, 8);
+		k += JSB_DOC_END == bin[i - 1];
+		assert(off == (k ? ends[k - 1] : 0));
+		assert((JSB_ERROR == n) == (off != i));
+		free(tight);
+	}
+	assert(jsb_pred_compile(&f, pred, JSB_PRED_MAX + 1) == JSB_ERROR);
+}
+
+/* converted binary verifies and indexes like jsb_analyze(), while no prefix of it verifies */
+static void chk_verify(const uint8_t *bin, size_t len){
+	size_t m0[64], m1[64], i;
+	memset(m0, 0, sizeof(m0));
+	memset(m1, 0, sizeof(m1));
+	assert(jsb_analyze(bin, 0, m0, 64, 0) <= 64);
+	assert(jsb_verify(bin, len, 0, -1, m1, 64, 0) == 1);
+	assert(memcmp(m0, m1, sizeof(m0)) == 0);
+	assert(jsb_verify(bin, len, JSB_LINES, -1, NULL, 0, 0) == 1);
+	for(i = 0; i < len; i++)
+		assert(jsb_verify(bin, i, 0, -1, NULL, 0, 0) == JSB_ERROR);
+}
+
+static void chk_verify_bad(void){
+	static const char *bad[] = {
+		"",
+		JSB_DOC_END_S,
+		JSB_KEY_S "a" JSB_DOC_END_S,
+		JSB_NULL_S,
+		JSB_NULL_S JSB_DOC_END_S JSB_NULL_S JSB_DOC_END_S,
+		JSB_NULL_S JSB_DOC_END_S "x",
+		JSB_ARR_S JSB_OBJ_END_S JSB_DOC_END_S,
+		JSB_ARR_S JSB_KEY_S "a" JSB_ARR_END_S JSB_DOC_END_S,
+		JSB_OBJ_S JSB_STR_S "a" JSB_NULL_S JSB_OBJ_END_S JSB_DOC_END_S,
+		JSB_OBJ_S JSB_KEY_S "a" JSB_OBJ_END_S JSB_DOC_END_S,
+		JSB_OBJ_S JSB_KEY_S "a" JSB_KEY_S "b" JSB_OBJ_END_S JSB_DOC_END_S,
+		JSB_ARR_S JSB_DOC_END_S,
+		JSB_STR_S "\xc0\x80" JSB_DOC_END_S,
+		JSB_STR_S "\xed\xa0\x80" JSB_DOC_END_S,
+		JSB_STR_S "abcdefgh\xe2\x82" JSB_DOC_END_S,
+		JSB_NUM_S JSB_DOC_END_S,
+		JSB_NUM_S "01" JSB_DOC_END_S,
+		JSB_NUM_S "1e+5" JSB_DOC_END_S,
+		JSB_NUM_S "1E5" JSB_DOC_END_S,
+		JSB_NUM_S "-" JSB_DOC_END_S,
+		JSB_NUM_S "1." JSB_DOC_END_S,
+	};
+	static const char two[] = JSB_STR_S "abcdefghij\xc3\xa9" JSB_DOC_END_S JSB_NUM_S "-1.5e-7" JSB_DOC_END_S;
+	static const char deep[] = JSB_ARR_S JSB_ARR_S JSB_ARR_END_S JSB_ARR_END_S JSB_DOC_END_S;
+	size_t i;
+	for(i = 0; i < sizeof(bad) / sizeof(*bad); i++)
+		assert(jsb_verify(bad[i], strlen(bad[i]), 0, -1, NULL, 0, 0) == JSB_ERROR);
+	assert(jsb_verify(two, sizeof(two) - 1, 0, -1, NULL, 0, 0) == JSB_ERROR);
+	assert(jsb_verify(two, sizeof(two) - 1, JSB_LINES, -1, NULL, 0, 0) == 2);
+	assert(jsb_verify("", 0, JSB_LINES, -1, NULL, 0, 0) == 0);
+	assert(jsb_verify(deep, sizeof(deep) - 1, 0, 2, NULL, 0, 0) == 1);
+	assert(jsb_verify(deep, sizeof(deep) - 1, 0, 1, NULL, 0, 0) == JSB_ERROR);
+}
+
+/* profiling builds should charge every byte read to some parser state */
+static void chk_stats(void){
+	static const char json[] = "{\"a\":[1.5,\"\\u00e9\",true]}";
+	uint8_t bin[64];
+	uint64_t before = 0, after = 0;
+	const jsb_stat_t *st;
+	size_t i, n;
+	st = jsb_stats(&n);
+	assert(!n == !st);
+	for(i = 0; i < n; i++)
+		before += st[i].bytes;
+	assert(JSB_ERROR != jsb(bin, sizeof(bin), json, sizeof(json) - 1, 0, -1));
+	for(i = 0; i < n; i++)
+		after += st[i].bytes;
+	assert(!n || after - before >= sizeof(json) - 1);
+}
+
+/* measured JSON length should match actual output for all flag combinations */
+static void chk_measure(const char *json){
+	uint8_t bin[1024];
+	char txt[1024];
+	uint32_t flags;
+	size_t len, blen = jsb(bin, sizeof(bin), json, strlen(json), 0, -1);
+	assert(JSB_ERROR != blen);
+	for(flags = 0; flags <= (JSB_ASCII | JSB_LINES); flags += JSB_ASCII){
+		len = jsb(txt, sizeof(txt), bin, blen, flags | JSB_REVERSE, -1);
+		assert(JSB_ERROR != len);
+		assert(jsb_measure(bin, 0, flags) == len);
+	}
+	bin[0] = JSB_OBJ_END;
+	assert(jsb_measure(bin, 0, 0) == JSB_ERROR);
+}
+
+/* convert in place, both all at once and trickling input/output space */
+static void chk_inplace(const char *json, uint32_t flags){
+	uint8_t buf[1024], ref[1024];
+	size_t len = strlen(json), n, rv, end;
+	jsb_t j;
+	n = jsb(ref, sizeof(ref), json, len, flags, -1);
+	assert(n <= len + 2);
+	memcpy(buf, json, len);
+	assert(jsb(buf, len + 2, buf, len, flags, -1) == n);
+	assert(memcmp(buf, ref, n) == 0);
+	memcpy(buf, json, len);
+	assert(jsb(buf, n - 1, buf, len, flags, -1) == JSB_ERROR);
+
+	memcpy(buf, json, len);
+	jsb_init(&j, flags | JSB_INPLACE, 0);
+	j.next_in = j.next_out = buf;
+	j.avail_in = j.avail_out = 0;
+	end = 0;
+	do{
+		if(!j.avail_in){
+			if(end < len)
+				j.avail_in++, end++;
+			else
+				jsb_eof(&j);
+		}
+		if(!j.avail_out)
+			j.avail_out++;
+		rv = jsb_update(&j);
+	}while(JSB_OK == rv);
+	assert(JSB_DONE == rv && j.total_out == n);
+	assert(j.next_out == buf + n && memcmp(buf, ref, n) == 0);
+}
+
+/* rebuild binary through the writer, entering every other container */
+static void chk_curwalk(jsb_cur_t *c, jsb_w_t *w){
+	uint8_t t;
+	size_t n = 0;
+	while((t = jsb_cur_next(c))){
+		assert(c->ptr == c->base + c->offset + 1);
+		switch(t){
+			case JSB_OBJ:
+			case JSB_ARR:
+				assert(chk_drain(w, JSB_OBJ == t ? jsb_w_obj(w) : jsb_w_arr(w)) == JSB_OK);
+				assert(jsb_cur_enter(c) == JSB_OK);
+				if(n++ & 1){
+					chk_curwalk(c, w);
+				}else{
+					/* write via a second cursor, then skip the rest */
+					jsb_cur_t d = *c;
+					chk_curwalk(&d, w);
+					jsb_cur_next(c);
+				}
+				assert(jsb_cur_leave(c) == JSB_OK && c->type == t);
+				chk_drain(w, jsb_w_end(w));
+				break;
+			case JSB_KEY: chk_drain(w, jsb_w_key(w, c->ptr, c->len)); break;
+			case JSB_STR: chk_drain(w, jsb_w_str(w, c->ptr, c->len)); break;
+			case JSB_NUM: chk_drain(w, jsb_w_num(w, c->ptr, c->len)); break;
+			case JSB_NULL: chk_drain(w, jsb_w_null(w)); break;
+			default: chk_drain(w, jsb_w_bool(w, JSB_TRUE == t)); break;
+		}
+		assert(jsb_cur_skip(c) == jsb_size(c->base, c->offset, NULL));
+	}
+}
+
+static void chk_cursor(uint8_t *bin){
+	uint8_t out[1024];
+	size_t meta[256], *m = NULL;
+	size_t len = jsb_size(bin, 0, NULL) + 1;
+	jsb_cur_t c;
+	jsb_w_t w;
+	int i;
+	jsb_analyze(bin, 0, meta, sizeof(meta)/sizeof(*meta), 0);
+	for(i = 0; i < 2; i++, m = meta){
+		assert(jsb_cur_init(&c, bin, 0, m, 0) == JSB_DEFAULT_DEPTH);
+		assert(jsb_cur_leave(&c) == JSB_ERROR);
+		jsb_w_init(&w, 0, 0);
+		w.next_out = out;
+		w.avail_out = 1;
+		chk_curwalk(&c, &w);
+		assert(!c.depth && jsb_cur_next(&c) == 0);
+		assert(w.total_out == len && memcmp(bin, out, len) == 0);
+	}
+	/* items are visible only from within their container */
+	jsb_cur_init(&c, bin, 0, NULL, jsb_cur_units(1) * sizeof(jsb_unit_t));
+	assert(c.maxdepth == 1 && jsb_cur_enter(&c) == JSB_ERROR);
+	assert(jsb_cur_next(&c) == bin[0] && jsb_cur_enter(&c) == JSB_OK);
+	assert(jsb_cur_next(&c) && jsb_cur_leave(&c) == JSB_OK);
+	assert(c.type == bin[0] && jsb_cur_skip(&c) == len - 1);
+}
+
 int main(void){
 	const int npass = sizeof(pass) / sizeof(*pass);
 	const int nsubs = sizeof(subs) / sizeof(*subs);
@@ -133,6 +888,10 @@ int main(void){
 		assert(memcmp(txt, tmp, len + 1) == 0);
 		assert(txt[len] == 0);
 		assert(plen == len);
+		assert(jsb_measure(bin, 0, 0) == len);
+		chk_budget(pass[i], plen, 0);
+		chk_budget(bin, blen, JSB_REVERSE);
+		chk_verify(bin, blen);
 		r = memcmp(pass[i], txt, len);
 		assert(!r);
 	}
@@ -167,6 +926,8 @@ int main(void){
 
 	chk_analyze(bin);
 
+	chk_cursor(bin);
+
 	/* build binary array from the above key/value list */
 	blen = 0;
 	bin[blen++] = JSB_ARR;
@@ -195,7 +956,43 @@ int main(void){
 
 	chk_analyze(bin);
 
+	chk_cursor(bin);
+
 	chk_match();
 
+	chk_cmp();
+	chk_stats();
+	chk_verify_bad();
+	chk_words();
+	chk_records();
+	chk_columns();
+	chk_aggregate();
+	chk_filter();
+
+	chk_num();
+
+	chk_fmt();
+
+	chk_writer();
+
+	for(i = 0; i < npass; i++){
+		for(len = 1; len < 9; len++){
+			assert(chk_events(pass[i], len, 1, 0) == JSB_DONE);
+			assert(chk_events(pass[i], len, 7, 0) == JSB_DONE);
+		}
+	}
+	assert(chk_events("\"a\\u00e9\\ud83d\\ude00z\" [12.5E+01, {\"k\":\"\"}]", 3, 2, JSB_LINES) == JSB_DONE);
+	assert(chk_events("[1, 2,]", 3, 2, 0) == JSB_ERROR);
+
+	chk_measure("[\"\\u0000\\u001f\\b\\t\\n\\f\\r\\\"\\\\/\\u007f\", {\"\\u00e9\\u20ac\\ud83d\\ude00\":[-1.5e-3,true,false,null]}]");
+	chk_measure("{\"\":{},\"a\":[[],{}]}");
+
+	chk_batch();
+
+	for(i = 0; i < npass; i++)
+		chk_inplace(pass[i], 0);
+	chk_inplace("[1,2,-3,4e0,5E-06,{\"\":0}]", 0);
+	chk_inplace("[1] {\"a\": 2}\n\"\\u0041\"", JSB_LINES);
+
 	return 0;
 }
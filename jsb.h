@@ -24,6 +24,13 @@ extern "C"
 #define JSB_REVERSE   2 /* input binary, output json                            */
 #define JSB_ASCII     4 /* when emitting json, escape all codepoints above 0x7f */
 #define JSB_LINES     8 /* parse sequences of documents in either direction     */
+#define JSB_INPLACE  32 /* output trails input within the same buffer (json in) */
+
+/* flag bits for jsb_w_init() - JSB_LINES applies as well */
+#define JSB_VALIDATE 16 /* check UTF-8 of strings/keys and syntax of numbers   */
+
+/* flag bit for jsb_event_fn events - more of the same key/string/number follows */
+#define JSB_PARTIAL 256
 
 /* flag bits for jsb_prepare() */
 #define JSB_STRLEN    1
@@ -33,9 +40,16 @@ extern "C"
 #define JSB_DONE      1
 #define JSB_ERROR     ((size_t)-1)
 
+/* additional return codes for jsb_num_*() */
+#define JSB_EXACT     0
+#define JSB_INEXACT   1
+
 /* largest valid size */
 #define JSB_SIZE_MAX  (SIZE_MAX - 4)
 
+/* room required by jsb_fmt_*() */
+#define JSB_FMT_MAX   32
+
 /* binary value type markers */
 #define JSB_OBJ        0xf5
 #define JSB_ARR        0xf6
@@ -72,8 +86,14 @@ extern "C"
 
 #define JSB_SIZE (sizeof(jsb_t) - JSB_DEFAULT_STACK_BYTES)
 
+/* bytes of output that JSB_INPLACE may hold back from overrunning unread input */
+#define JSB_SPILL 4
+
+/* event callback for jsb_events() - return JSB_OK to continue parsing */
+typedef size_t (*jsb_event_fn)(void *ctx, uint32_t event, const uint8_t *ptr, size_t len);
+
 typedef struct {
-	/* client may modify only these six fields */
+	/* client may modify only these eight fields */
 	const uint8_t *next_in;
 	size_t        avail_in;
 	uint64_t      total_in;
@@ -82,6 +102,10 @@ typedef struct {
 	size_t        avail_out;
 	uint64_t      total_out;
 
+	/* optional limits on input consumed/output produced per jsb_update() (zero for none) */
+	size_t        budget_in;
+	size_t        budget_out;
+
 	/* current json parser depth */
 	size_t depth;
 
@@ -96,13 +120,160 @@ typedef struct {
 	unsigned flag_reverse:1;
 	unsigned flag_ascii:1;
 	unsigned flag_lines:1;
+	unsigned flag_inplace:1;
 	uint8_t state;
 	uint8_t misc;
 	uint8_t outb;
 	uint8_t ch;
+	uint8_t spill_len;
+	uint8_t spill[JSB_SPILL];
+	uint8_t ev_type;
+	jsb_event_fn ev_fn;
+	void *ev_ctx;
+	uint8_t *ev_buf;
+	size_t ev_len;
+	size_t ev_pend;
 	uint8_t stack[JSB_DEFAULT_STACK_BYTES];
 } jsb_t;
 
+/* binary writer container bookkeeping */
+typedef struct {
+	uint64_t off; /* output position of the container token */
+	size_t cnt;   /* (item count << 1) | is object */
+} jsb_w_frame_t;
+
+#define JSB_W_SIZE (sizeof(jsb_w_t) - JSB_DEFAULT_DEPTH * sizeof(jsb_w_frame_t))
+
+typedef struct {
+	/* client may modify only these three fields */
+	uint8_t       *next_out;
+	size_t        avail_out;
+	uint64_t      total_out;
+
+	/* current container depth */
+	size_t depth;
+
+	/* maximum container depth */
+	const size_t maxdepth;
+
+	/* remaining fields are for internal use */
+	uint64_t pos;
+	uint64_t meta_base;
+	size_t *meta;
+	size_t meta_n;
+	size_t meta_m;
+	const uint8_t *ext;
+	size_t extlen;
+	unsigned key:1;
+	unsigned done:1;
+	unsigned tail:1;
+	unsigned flag_lines:1;
+	unsigned flag_validate:1;
+	uint8_t headpos;
+	uint8_t headlen;
+	uint8_t head[JSB_FMT_MAX + 1];
+	jsb_w_frame_t stack[JSB_DEFAULT_DEPTH];
+} jsb_w_t;
+
+#define JSB_CUR_SIZE (sizeof(jsb_cur_t) - JSB_DEFAULT_DEPTH * sizeof(size_t))
+
+typedef struct {
+	/* current item - type marker (zero before first/after last item), offset,
+	 * and the UTF-8 contents of numbers/strings/keys (len is zero otherwise)
+	 */
+	uint8_t type;
+	size_t offset;
+	const uint8_t *ptr;
+	size_t len;
+
+	/* current container depth */
+	size_t depth;
+
+	/* maximum container depth */
+	const size_t maxdepth;
+
+	/* remaining fields are for internal use */
+	const uint8_t *base;
+	const size_t *node;
+	size_t end;
+	size_t stack[JSB_DEFAULT_DEPTH];
+} jsb_cur_t;
+
+/* one conversion for jsb_batch() */
+typedef struct {
+	const void *src;
+	size_t srclen;
+	void *dst;
+	size_t dstlen;
+	size_t ret; /* set to what jsb() would return */
+} jsb_batch_t;
+
+/* per-state parser counters from jsb_stats() */
+typedef struct {
+	const char *name; /* state label, j_ for JSON => binary and r_ for binary => JSON */
+	uint64_t entries; /* jumps into the state */
+	uint64_t bytes;   /* input bytes read within it */
+	uint64_t yields;  /* returns to the caller from within it */
+} jsb_stat_t;
+
+/* column types for jsb_columns() */
+#define JSB_COL_I64  1 /* int64_t per row, for numbers that are exactly integers  */
+#define JSB_COL_F64  2 /* double per row, for any number                          */
+#define JSB_COL_BOOL 3 /* uint8_t per row, for true/false                         */
+#define JSB_COL_STR  4 /* size_t per row, offset of the UTF-8 contents of strings */
+
+/* one output column for jsb_columns() */
+typedef struct {
+	size_t key;        /* index of the field's top-level key within the prepared keys */
+	const void *path;  /* optional path below it, as for jsb_path_get() (or NULL) */
+	size_t pathlen;
+	uint32_t type;     /* JSB_COL_* */
+	void *data;        /* array of values, indexed by record */
+	size_t *lens;      /* JSB_COL_STR: byte length of each string's contents */
+	uint8_t *valid;    /* bitmap, bit (i & 7) of byte (i >> 3) set where record i held a value of type */
+} jsb_col_t;
+
+/* operators for jsb_pred_t, each holding where jsb_cmp(record value, term value) returns: */
+#define JSB_PRED_EQ  1 /*  1               */
+#define JSB_PRED_LT  2 /* -1               */
+#define JSB_PRED_LE  3 /* -1 or 1          */
+#define JSB_PRED_GT  4 /*  3               */
+#define JSB_PRED_GE  5 /*  1 or 3          */
+#define JSB_PRED_NE  6 /* anything but 1   */
+#define JSB_PRED_HAS 7 /* (value is there) */
+
+/* one term of a predicate over records, which holds when all of its terms do */
+typedef struct {
+	const void *path;  /* value tested, as for jsb_path_get() from the record (empty for the record itself) */
+	size_t pathlen;
+	uint32_t op;       /* JSB_PRED_* */
+	const void *base;  /* value tested against, at base + offset (unused by JSB_PRED_HAS) */
+	size_t offset;
+} jsb_pred_t;
+
+/* terms per compiled predicate */
+#define JSB_PRED_MAX 16
+
+/* predicate compiled by jsb_pred_compile() */
+typedef struct {
+	const jsb_pred_t *pred;
+	size_t npred;
+	const void *keys[JSB_PRED_MAX];        /* distinct first keys of the terms' paths */
+	size_t keyinfo[2 * JSB_PRED_MAX + 1];  /* as prepared for jsb_match() */
+	size_t slot[JSB_PRED_MAX];             /* each term's key, or JSB_ERROR for the record itself */
+	size_t skip[JSB_PRED_MAX];             /* path bytes up to the rest of each term's path */
+	size_t len[JSB_PRED_MAX];              /* path bytes in all */
+} jsb_filter_t;
+
+/* aggregates accumulated by jsb_aggregate() - zero before first use */
+typedef struct {
+	uint64_t rows;             /* records that passed the predicate */
+	uint64_t count;            /* of which held a number at the path */
+	double sum, min, max;      /* of those numbers */
+	int64_t isum, imin, imax;  /* the same, exactly, while inexact is zero */
+	unsigned inexact;          /* set once a number was not an exact int64, or isum overflowed */
+} jsb_agg_t;
+
 /* jsb_units() reports dynamic jsb size as a multiple of these */
 typedef union {
 	uint64_t u64;
@@ -121,9 +292,19 @@ typedef union {
  * notes:
  *  when emitting JSON, appends null byte to output, but does not include it in the returned size
  *  pass maxdepth=(size_t)-1 to request default maxdepth (64)
+ *  pass dst == src (with dstlen >= srclen + 2) to convert JSON to binary in place
  */
 JSB_API size_t jsb(void *dst, size_t dstlen, const void *src, size_t srclen, uint32_t flags, size_t maxdepth);
 
+/* run jsb() over n items, sharing one parser allocation
+ * return:
+ *  number of items converted successfully - see each item's ret for details
+ * note:
+ *  after an item that parsed to the end, the next only resets the parser's
+ *  position and counters - a full jsb_init() is done first and after errors
+ */
+JSB_API size_t jsb_batch(jsb_batch_t *items, size_t n, uint32_t flags, size_t maxdepth);
+
 
 /**
  * Streaming API
@@ -152,6 +333,10 @@ JSB_API size_t __attribute__((const)) jsb_units(size_t maxdepth);
  *  JSB_ASCII
  *  JSB_LINES
  *  JSB_EOF
+ *  JSB_INPLACE: next_out starts at next_in and trails it through the same buffer,
+ *               with avail_out covering the whole buffer from next_out - which
+ *               needs two bytes more than the JSON to guarantee room for binary
+ *               (per document - JSB_ERROR is returned should binary overrun input)
  * note:
  *  pass jsbsize < JSB_SIZE (recommend: 0) to indicate default jsb stack bytes
  */
@@ -163,6 +348,7 @@ JSB_API size_t jsb_init(jsb_t *jsb, uint32_t flags, size_t jsbsize);
  *  JSB_ERROR: something has gone awry
  * note:
  *  on JSB_OK, caller should check if input/output fields need updating
+ *  with a budget set, JSB_OK may also mean the budget was used up - just call again
  *  duplicate keys are preserved
  *  key order is preserved
  *  for JSON => binary:
@@ -176,6 +362,32 @@ JSB_API size_t jsb_update(jsb_t *jsb);
  */
 JSB_API void jsb_eof(jsb_t *jsb);
 
+/* counters kept by a profiling build (make profile=1) for each state of the parser
+ * return:
+ *  *n counters, accumulated over every jsb_update() call since load,
+ *  or NULL with *n set to zero in other builds
+ * note:
+ *  the counts are shared by all parsers and are not updated atomically
+ */
+JSB_API const jsb_stat_t *jsb_stats(size_t *n);
+
+/* switch a freshly initialized JSON => binary parser to event mode, where
+ * jsb_update() calls fn for each binary token instead of writing to next_out
+ * return:
+ *  JSB_OK, or JSB_ERROR for JSB_REVERSE/JSB_INPLACE parsers or zero-length scratch space
+ * note:
+ *  event is the binary marker for the token [0xf5 .. 0xff], including JSB_KEY,
+ *  container ends, and JSB_DOC_END after each document
+ *  ptr/len span the UTF-8 contents of keys/strings/numbers (len is zero otherwise),
+ *  in canonical binary form, and are only valid for the duration of the call
+ *  contents that do not fit within the scratch space are split across several
+ *  events, all but the last having JSB_PARTIAL set
+ *  input validation is identical, and an error may follow events already delivered
+ *  if fn returns anything but JSB_OK, jsb_update() returns JSB_ERROR from then on
+ *  next_out/avail_out are left untouched, while total_out counts binary bytes
+ */
+JSB_API size_t jsb_events(jsb_t *jsb, jsb_event_fn fn, void *ctx, void *scratch, size_t len);
+
 
 /**
  * Binary traversal API
@@ -209,6 +421,41 @@ JSB_API size_t jsb_bool(const void *base, size_t offset);
  */
 JSB_API size_t jsb_analyze(const void *base, size_t offset, size_t *meta, size_t n, size_t m);
 
+/* check that len bytes at base are well-formed binary, so the functions below may
+ * safely traverse it: one document (any number with JSB_LINES in flags) each ending
+ * in JSB_DOC_END, balanced containers no more than maxdepth deep, objects holding
+ * key/value pairs, UTF-8 keys/strings, and numbers in the canonical form jsb() emits
+ * optionally fill meta as jsb_analyze() does, covering every document (or pass NULL)
+ * return:
+ *  number of documents, or JSB_ERROR
+ * note:
+ *  pass maxdepth=(size_t)-1 to request default maxdepth (64)
+ */
+JSB_API size_t jsb_verify(const void *base, size_t len, uint32_t flags, size_t maxdepth, size_t *meta, size_t n, size_t m);
+
+/* find records of JSB_LINES binary, each ending in a JSB_DOC_END byte
+ *  scan base from offset off up to len
+ *  store into ends the offset just past each record, up to n of them
+ * return number of records stored
+ * note:
+ *  when n are returned, more may follow - call again from off = ends[n - 1]
+ *  bytes after the last JSB_DOC_END do not form a record
+ */
+JSB_API size_t jsb_records(const void *base, size_t off, size_t len, size_t *ends, size_t n);
+
+/* cut len bytes of JSB_LINES binary into at most n segments of similar size, each one
+ * a run of whole records that converts independently of the others (e.g. on its own thread)
+ * stores the offset just past each segment into cuts
+ * return number of segments, whose last one always ends at len
+ */
+JSB_API size_t jsb_split(const void *base, size_t len, size_t *cuts, size_t n);
+
+/* look up record i of the n in a table filled by jsb_records() from offset zero
+ * return offset of the record, storing its length (JSB_DOC_END included) into len (if non-NULL),
+ * or JSB_ERROR for i >= n
+ */
+JSB_API size_t jsb_record_get(const size_t *ends, size_t n, size_t i, size_t *len);
+
 /* return number of bytes backing value or zero on error
  * optionally pass meta as filled by jsb_analyze() (or NULL)
  * note:
@@ -223,6 +470,24 @@ JSB_API size_t jsb_size(const void *base, size_t offset, const size_t *meta);
  */
 JSB_API size_t jsb_count(const void *base, size_t offset, const size_t *meta);
 
+/* jsb_size() and jsb_count() for a value somewhere in the len bytes at base
+ * return zero (jsb_size_n) or JSB_ERROR (jsb_count_n) if the value does not end within them
+ * note:
+ *  nothing at or past base + len is read, so binary needn't be followed by a marker
+ *  knowing the end lets these scan a word at a time - jsb_obj_get(), jsb_arr_get()
+ *  and jsb_match() do the same within containers meta indexes
+ */
+JSB_API size_t jsb_size_n(const void *base, size_t offset, size_t len, const size_t *meta);
+JSB_API size_t jsb_count_n(const void *base, size_t offset, size_t len, const size_t *meta);
+
+/* compute exact byte length of the JSON that jsb() would emit for the value at offset
+ * flags that may be bitwise OR'd:
+ *  JSB_ASCII: account for escaping codepoints above 0x7f
+ *  JSB_LINES: account for the trailing newline
+ * return length (not including the null terminator) or JSB_ERROR on error
+ */
+JSB_API size_t jsb_measure(const void *base, size_t offset, uint32_t flags);
+
 /* scans object to fetch offset of first value associated with provided key
  * optionally pass meta as filled by jsb_analyze() (or NULL)
  * return 0 on failure
@@ -236,6 +501,15 @@ JSB_API size_t jsb_obj_get(const void *base, size_t offset, const size_t *meta,
  */
 JSB_API size_t jsb_arr_get(const void *base, size_t offset, const size_t *meta, size_t idx);
 
+/* follow a path of keys from the value at offset, e.g. "user" JSB_KEY_S "id"
+ * keys are separated by JSB_KEY bytes (which keys never contain), and a key
+ * reaching an array is read as a decimal index, e.g. "tags" JSB_KEY_S "0"
+ * optionally pass meta as filled by jsb_analyze() (or NULL)
+ * return 0 on failure, or offset itself for an empty path
+ * pass len = -1 to call strlen() internally
+ */
+JSB_API size_t jsb_path_get(const void *base, size_t offset, const size_t *meta, const void *path, size_t len);
+
 /* for matching against json objects - client should:
  * a) construct an array of n*2+1 size_t's, containing:
  *  1) number of keys (n) in the first slot
@@ -262,6 +536,63 @@ JSB_API void jsb_prepare(size_t *keyinfo, const void *keys, uint32_t flags);
  */
 JSB_API size_t jsb_match(const void *base, size_t offset, const size_t *meta, const void *keys, const size_t *keyinfo, size_t *offsets);
 
+/* extract fields of records [first, first + count) of the n in a table filled by
+ * jsb_records() from offset zero into ncols columns, at row i for record i
+ * keys/keyinfo as passed to jsb_match(), which fills offsets (room for a slot per key)
+ * optionally pass meta as filled by jsb_verify() (or NULL)
+ * return:
+ *  count, or JSB_ERROR if the range runs past n
+ * note:
+ *  rows that lack a field or hold another type are zeroed, with their valid bit clear
+ *  ranges may be extracted concurrently (each with its own offsets) when they start
+ *  on multiples of 8, so that no two of them share a byte of a valid bitmap
+ */
+JSB_API size_t jsb_columns(const void *base, const size_t *ends, size_t n, size_t first, size_t count, const size_t *meta, const void *keys, const size_t *keyinfo, size_t *offsets, jsb_col_t *cols, size_t ncols);
+
+/* compile npred terms of pred into f, so that each record's object is scanned just once, by jsb_match(),
+ * to find the first key of every term's path
+ * return:
+ *  JSB_OK, or JSB_ERROR for more than JSB_PRED_MAX terms
+ * note:
+ *  pred, its paths, and its values must stay as they are while f is in use
+ */
+JSB_API size_t jsb_pred_compile(jsb_filter_t *f, const jsb_pred_t *pred, size_t npred);
+
+/* return 1 if all terms of f hold for the record at offset, otherwise 0
+ * optionally pass meta as filled by jsb_verify() (or NULL)
+ * note:
+ *  no term holds where its path reaches no value, while JSB_PRED_NE holds between values
+ *  that jsb_cmp() cannot compare (such as containers, or a string and a number)
+ */
+JSB_API size_t jsb_test(const jsb_filter_t *f, const void *base, size_t offset, const size_t *meta);
+
+/* scan whole records of JSB_LINES binary from offset *off up to len for those passing f,
+ * storing the start and end offsets of each into hits (two slots per record), up to n records
+ * optionally pass meta as filled by jsb_verify() (or NULL)
+ * return:
+ *  number of records stored, with *off advanced past the records scanned,
+ *  or JSB_ERROR should a record not end in JSB_DOC_END by len
+ * note:
+ *  when n are returned, more may follow - call again until *off reaches len
+ */
+JSB_API size_t jsb_filter(const jsb_filter_t *f, const void *base, size_t *off, size_t len, const size_t *meta, size_t *hits, size_t n);
+
+/* aggregate the numbers at path over whole records of JSB_LINES binary from offset off up to len,
+ * taking only records for which all npred terms of pred hold (pass npred = 0 for every record)
+ * optionally pass meta as filled by jsb_verify() (or NULL)
+ * return:
+ *  number of records scanned, or JSB_ERROR should a record not end in JSB_DOC_END by len
+ * note:
+ *  pass pathlen = -1 to call strlen() internally
+ *  integers are summed exactly, and everything as a double, via jsb_num_i64()/jsb_num_f64()
+ *  up to JSB_PRED_MAX terms are compiled as by jsb_pred_compile(), any more are looked up one by one
+ *  ranges cut by jsb_split() may be aggregated concurrently, then merged with jsb_agg_merge()
+ */
+JSB_API size_t jsb_aggregate(const void *base, size_t off, size_t len, const size_t *meta, const void *path, size_t pathlen, const jsb_pred_t *pred, size_t npred, jsb_agg_t *agg);
+
+/* fold the aggregates of from into agg, as if one jsb_aggregate() call had seen both ranges */
+JSB_API void jsb_agg_merge(jsb_agg_t *agg, const jsb_agg_t *from);
+
 /* compare two scalar json values of matching class
  * returns:
  *     0: error (arrays, objects, mismatched value class, or bad type code)
@@ -279,6 +610,155 @@ JSB_API size_t jsb_match(const void *base, size_t offset, const size_t *meta, co
  */
 JSB_API int jsb_cmp(const void *base0, size_t offset0, const void *base1, size_t offset1);
 
+
+/**
+ * Cursor API
+ **/
+
+/* Walks binary sequentially, visiting each byte once - containers are only scanned
+ * when skipped over, and only when meta (as filled by jsb_analyze()) lacks them.
+ * Object items alternate between JSB_KEY and value. Same caveats as the traversal
+ * API apply to badly structured binary.
+ */
+
+/* return:
+ *  number of jsb_unit_t's required to hold a jsb_cur_t for desired maximum depth
+ * note:
+ *  pass maxdepth=(size_t)-1 to request default maxdepth (64)
+ */
+JSB_API size_t __attribute__((const)) jsb_cur_units(size_t maxdepth);
+
+/* position cursor just before the value at base + offset
+ * optionally pass meta as filled by jsb_analyze() (or NULL)
+ * return:
+ *  maximum supported container depth
+ * note:
+ *  pass csize < JSB_CUR_SIZE (recommend: 0) to indicate default depth
+ */
+JSB_API size_t jsb_cur_init(jsb_cur_t *c, const void *base, size_t offset, const size_t *meta, size_t csize);
+
+/* advance to the next item in the current container (or the top-level value)
+ * return:
+ *  type marker of the new current item, or zero if there are no more
+ */
+JSB_API uint8_t jsb_cur_next(jsb_cur_t *c);
+
+/* move past the current item without descending into it
+ * return:
+ *  byte size of the item, as jsb_size() would report, or zero if there is none
+ */
+JSB_API size_t jsb_cur_skip(jsb_cur_t *c);
+
+/* descend into the current object/array, positioning just before its first item
+ * return:
+ *  JSB_OK, or JSB_ERROR if current item is not a container or maxdepth is reached
+ */
+JSB_API size_t jsb_cur_enter(jsb_cur_t *c);
+
+/* skip any remaining items, then return to the container last entered, which
+ * becomes the current item again
+ * return:
+ *  JSB_OK, or JSB_ERROR if at top level or binary is malformed
+ */
+JSB_API size_t jsb_cur_leave(jsb_cur_t *c);
+
+/* convert number at offset to a native signed/unsigned integer or double
+ * returns:
+ *  JSB_EXACT:   *out holds the exact value of the number
+ *  JSB_INEXACT: *out holds the number truncated toward zero (integers) or rounded
+ *               to nearest, ties to even (double), saturating at the limits of the
+ *               output type (zero for negative numbers passed to jsb_num_u64)
+ *  JSB_ERROR:   value at offset is not a number and *out is left untouched
+ * note:
+ *  integer conversion honors fractions and exponents, so 1.5e1 yields 15 exactly
+ *  double conversion is correctly rounded for any number of digits
+ */
+JSB_API size_t jsb_num_i64(const void *base, size_t offset, int64_t *out);
+JSB_API size_t jsb_num_u64(const void *base, size_t offset, uint64_t *out);
+JSB_API size_t jsb_num_f64(const void *base, size_t offset, double *out);
+
+/* write a native number to dst as a JSB_NUM token plus digits (no trailing token)
+ * dst must have room for at least JSB_FMT_MAX bytes
+ * returns:
+ *  number of bytes written, or JSB_ERROR for infinities/NaNs (nothing is written)
+ * note:
+ *  doubles are written with the fewest digits that convert back to the same value,
+ *  in plain notation for 1e-6 <= |v| < 1e21, and scientific notation otherwise
+ */
+JSB_API size_t jsb_fmt_i64(void *dst, int64_t v);
+JSB_API size_t jsb_fmt_u64(void *dst, uint64_t v);
+JSB_API size_t jsb_fmt_f64(void *dst, double v);
+
+
+/**
+ * Binary writer API
+ **/
+
+/* These build binary directly, without a round trip through JSON text. Each call
+ * appends a complete key/value/container token to next_out, and terminates each
+ * top-level value with JSB_DOC_END. Should avail_out reach zero, whatever did not
+ * fit is held (along with a reference to the caller's key/string/number bytes,
+ * which must remain valid) until the caller supplies more output space and calls
+ * jsb_w_flush(). Nothing else may be written while output is held.
+ *
+ * Unless JSB_VALIDATE is set, key/string/number bytes are copied as-is, and must
+ * be valid UTF-8 (strings) or canonical numbers as produced by jsb() (numbers).
+ */
+
+/* return:
+ *  number of jsb_unit_t's required to hold a jsb_w_t for desired maximum depth
+ * note:
+ *  pass maxdepth=(size_t)-1 to request default maxdepth (64)
+ */
+JSB_API size_t __attribute__((const)) jsb_w_units(size_t maxdepth);
+
+/* initialize writer state, except for next_out/avail_out
+ * return:
+ *  maximum supported container depth
+ * flags that may be bitwise OR'd:
+ *  JSB_LINES:    permit writing multiple top-level values
+ *  JSB_VALIDATE: reject invalid UTF-8 and non-canonical numbers
+ * note:
+ *  pass wsize < JSB_W_SIZE (recommend: 0) to indicate default depth
+ */
+JSB_API size_t jsb_w_init(jsb_w_t *w, uint32_t flags, size_t wsize);
+
+/* collect an index into meta, exactly as jsb_analyze() would, while writing the next
+ * top-level value - offsets are relative to total output at the time of this call
+ * return:
+ *  JSB_OK, or JSB_ERROR if not between top-level values or n is too small
+ * note:
+ *  meta is complete once the value has been written, with the item count in meta[0]
+ */
+JSB_API size_t jsb_w_index(jsb_w_t *w, size_t *meta, size_t n, size_t m);
+
+/* write a value, key, or container boundary
+ * return:
+ *  JSB_OK:    item was written (or held - see above)
+ *  JSB_DONE:  item completed a top-level value
+ *  JSB_ERROR: item is invalid here, or failed validation (nothing is written)
+ * note:
+ *  pass len = -1 to call strlen() internally
+ *  jsb_w_end() closes the innermost open object or array
+ */
+JSB_API size_t jsb_w_obj(jsb_w_t *w);
+JSB_API size_t jsb_w_arr(jsb_w_t *w);
+JSB_API size_t jsb_w_end(jsb_w_t *w);
+JSB_API size_t jsb_w_key(jsb_w_t *w, const void *key, size_t len);
+JSB_API size_t jsb_w_str(jsb_w_t *w, const void *str, size_t len);
+JSB_API size_t jsb_w_num(jsb_w_t *w, const void *num, size_t len);
+JSB_API size_t jsb_w_i64(jsb_w_t *w, int64_t v);
+JSB_API size_t jsb_w_u64(jsb_w_t *w, uint64_t v);
+JSB_API size_t jsb_w_f64(jsb_w_t *w, double v);
+JSB_API size_t jsb_w_bool(jsb_w_t *w, int v);
+JSB_API size_t jsb_w_null(jsb_w_t *w);
+
+/* write held output to next_out
+ * return:
+ *  JSB_OK - caller should check if avail_out is zero, which may mean output is still held
+ */
+JSB_API size_t jsb_w_flush(jsb_w_t *w);
+
 #ifdef __cplusplus
 }
 #endif
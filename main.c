@@ -6,16 +6,37 @@
 #include<assert.h>
 #include<errno.h>
 #include<getopt.h>
+#include<pthread.h>
 #include<inttypes.h>
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
+#include<fcntl.h>
 #include<sys/ioctl.h>
 #include<sys/mman.h>
 #include<sys/stat.h>
+#include<sys/uio.h>
 #include<time.h>
 #include<unistd.h>
 
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define URING 1
+#include<linux/io_uring.h>
+#endif
+#if __has_include(<linux/perf_event.h>)
+#define PERF 1
+#include<linux/perf_event.h>
+#endif
+#include<sys/syscall.h>
+#endif
+#ifndef URING
+#define URING 0
+#endif
+#ifndef PERF
+#define PERF 0
+#endif
+
 #include"jsb.h"
 
 typedef struct {
@@ -47,22 +68,40 @@ static void *block_init(block_t *bk, int fd, size_t size, int stream){
 		size = ps;
 
 	if(!stream){
-		data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		max = lseek(fd, 0, SEEK_END);
+		if(max < 1)
+			stream = 1;
+	}
+	if(!stream && (uint64_t)max < SIZE_MAX / 2){
+		/* map the whole file once, rather than stepping a window along it */
+		data = mmap(NULL, max, PROT_READ, MAP_SHARED, fd, 0);
 		if(MAP_FAILED == data){
 			data = NULL;
-			stream = 1;
+		}else{
+			size = max + (max % ps ? ps - max % ps : 0);
+			madvise(data, size, MADV_SEQUENTIAL);
+			madvise(data, size, MADV_WILLNEED);
 		}
 	}
-	if(!stream){
-		max = lseek(fd, 0, SEEK_END);
-		if(max < 1)
+	if(!stream && !data){
+		data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if(MAP_FAILED == data){
+			data = NULL;
 			stream = 1;
+		}else{
+			madvise(data, size, MADV_SEQUENTIAL);
+		}
 	}
 	if(lseek(fd, 0, SEEK_SET))
 		stream = 1;
 
-	if(stream)
+	if(stream){
 		data = mmap(data, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|(data ? MAP_FIXED : 0), -1, 0);
+#ifdef MADV_HUGEPAGE
+		if(MAP_FAILED != data)
+			madvise(data, size, MADV_HUGEPAGE);
+#endif
+	}
 
 	bk->fd = fd;
 	bk->state = MAP_FAILED == data ? 0 : (stream ? 1 : 2);
@@ -100,7 +139,7 @@ static size_t block_next(block_t *bk){
 			break;
 		case 2: /* initial mmap'd entrypoint */
 			/* already loaded first block - just return it */
-			if(r > bk->max){
+			if(r >= bk->max){
 				r = bk->max;
 				bk->state = 0;
 			}else{
@@ -143,6 +182,1357 @@ static int fdwrite(int fd, const void *buf, size_t len){
 	return 0;
 }
 
+/* pick conversion direction from the first input byte, return 0 for hopeless input */
+static int sniff(uint8_t ch, uint32_t *flags){
+	switch(ch){
+		case JSB_NULL:
+		case JSB_TRUE:
+		case JSB_FALSE:
+		case JSB_NUM:
+		case JSB_STR:
+		case JSB_OBJ:
+		case JSB_ARR:
+			*flags |= JSB_REVERSE;
+			/* fall through */
+		default:
+			return 1;
+		case 0xc0:
+		case 0xc1:
+		case JSB_OBJ_END:
+		case JSB_ARR_END:
+		case JSB_DOC_END:
+			return 0;
+	}
+}
+
+/* read all input into a single buffer, with two bytes to spare for in-place conversion */
+static uint8_t *slurp(int fd, size_t *len, size_t *size){
+	struct stat st;
+	size_t n = 0, sz = 1<<24;
+	uint8_t *buf, *tmp;
+	ssize_t r;
+	/* one spare byte lets the read loop see EOF without growing */
+	if(!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0)
+		sz = st.st_size + 1;
+	buf = malloc(sz + 2);
+	while(buf){
+		if(n == sz){
+			tmp = realloc(buf, (sz *= 2) + 2);
+			if(!tmp)
+				free(buf);
+			buf = tmp;
+			continue;
+		}
+		r = read(fd, buf + n, sz - n);
+		if(r < 0){
+			if(EINTR == errno || EAGAIN == errno)
+				continue;
+			free(buf);
+			buf = NULL;
+		}else if(!r){
+			break;
+		}else{
+			n += r;
+		}
+	}
+	if(buf && !n)
+		buf[0] = 0;
+	*len = n;
+	*size = sz + 2;
+	return buf;
+}
+
+static size_t page_round(size_t n){
+	size_t ps = pgsz();
+	n = (n + ps - 1) / ps * ps;
+	return n ? n : ps;
+}
+
+/* -T: wall time, cpu time and hardware counters of this thread, split into i/o and parse phases */
+enum { PH_IO, PH_PARSE, PH_COUNT };
+enum { CT_CYCLES, CT_INSTR, CT_BRANCH, CT_LLC, CT_COUNT };
+
+typedef struct {
+	int on, phase, leader, user;
+	unsigned nctr;
+	int slot[CT_COUNT];
+	double cpu0, t0[2], v0[CT_COUNT];
+	double t[PH_COUNT][2], v[PH_COUNT][CT_COUNT];
+} prof_t;
+
+static prof_t prof;
+
+static double seconds(clockid_t id){
+	struct timespec ts;
+	clock_gettime(id, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* read the counter group, scaled up when the kernel multiplexed it */
+static void prof_read(prof_t *p, double *v){
+	unsigned i;
+#if PERF
+	uint64_t buf[3 + CT_COUNT];
+	double scale = 1;
+	if(p->nctr && read(p->leader, buf, sizeof(buf)) >= (ssize_t)(3 + p->nctr) * 8){
+		if(buf[2] && buf[2] < buf[1])
+			scale = (double)buf[1] / buf[2];
+		for(i = 0; i < CT_COUNT; i++)
+			v[i] = p->slot[i] < 0 ? 0 : buf[3 + p->slot[i]] * scale;
+		return;
+	}
+#endif
+	for(i = 0; i < CT_COUNT; i++)
+		v[i] = 0;
+}
+
+/* counters that fail to open are left out; without any, only times are kept */
+static void prof_init(prof_t *p){
+	unsigned i;
+#if PERF
+	static const uint64_t config[CT_COUNT] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES
+	};
+	struct perf_event_attr a;
+	int fd;
+#endif
+	memset(p, 0, sizeof(*p));
+	p->on = 1;
+	p->leader = -1;
+	for(i = 0; i < CT_COUNT; i++){
+		p->slot[i] = -1;
+#if PERF
+		memset(&a, 0, sizeof(a));
+		a.size = sizeof(a);
+		a.type = PERF_TYPE_HARDWARE;
+		a.config = config[i];
+		a.exclude_hv = 1;
+		a.exclude_kernel = p->user;
+		a.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		fd = syscall(__NR_perf_event_open, &a, 0, -1, p->leader, 0);
+		if(fd < 0 && (EACCES == errno || EPERM == errno) && !p->user && p->leader < 0){
+			/* paranoid kernels still allow user space counts */
+			a.exclude_kernel = p->user = 1;
+			fd = syscall(__NR_perf_event_open, &a, 0, -1, p->leader, 0);
+		}
+		if(fd < 0)
+			continue;
+		if(p->leader < 0)
+			p->leader = fd;
+		p->slot[i] = p->nctr++;
+#endif
+	}
+	p->phase = PH_IO;
+	p->cpu0 = seconds(CLOCK_PROCESS_CPUTIME_ID);
+	p->t0[0] = seconds(CLOCK_MONOTONIC);
+	p->t0[1] = seconds(CLOCK_THREAD_CPUTIME_ID);
+	prof_read(p, p->v0);
+}
+
+/* charge everything since the last switch to the current phase */
+static void prof_enter(prof_t *p, int phase){
+	double t[2], v[CT_COUNT];
+	unsigned i;
+	if(!p->on)
+		return;
+	t[0] = seconds(CLOCK_MONOTONIC);
+	t[1] = seconds(CLOCK_THREAD_CPUTIME_ID);
+	prof_read(p, v);
+	for(i = 0; i < 2; i++){
+		p->t[p->phase][i] += t[i] - p->t0[i];
+		p->t0[i] = t[i];
+	}
+	for(i = 0; i < CT_COUNT; i++){
+		p->v[p->phase][i] += v[i] - p->v0[i];
+		p->v0[i] = v[i];
+	}
+	p->phase = phase;
+}
+
+static void prof_report(prof_t *p, uint64_t bytes){
+	static const char *name[PH_COUNT + 1] = { "io", "parse", "total" };
+	static const char *ctr[CT_COUNT] = { "cycles", "instructions", "branch_misses", "llc_misses" };
+	double t[2], v[CT_COUNT], b = bytes ? (double)bytes : 1;
+	const jsb_stat_t *st;
+	size_t n;
+	unsigned i, ph;
+	prof_enter(p, p->phase);
+	for(ph = 0; ph <= PH_COUNT; ph++){
+		for(i = 0; i < 2; i++)
+			t[i] = ph < PH_COUNT ? p->t[ph][i] : p->t[PH_IO][i] + p->t[PH_PARSE][i];
+		for(i = 0; i < CT_COUNT; i++)
+			v[i] = ph < PH_COUNT ? p->v[ph][i] : p->v[PH_IO][i] + p->v[PH_PARSE][i];
+		fprintf(stderr, "%s\twall_s=%.6f\tcpu_s=%.6f", name[ph], t[0], t[1]);
+		if(PH_COUNT == ph)
+			fprintf(stderr, "\tprocess_cpu_s=%.6f\tbytes=%" PRIu64 "\tmb_per_s=%.3f",
+				seconds(CLOCK_PROCESS_CPUTIME_ID) - p->cpu0, bytes, t[0] > 0 ? bytes / 1048576.0 / t[0] : 0);
+		for(i = 0; i < CT_COUNT; i++)
+			if(p->slot[i] >= 0)
+				fprintf(stderr, "\t%s_per_byte=%.4f", ctr[i], v[i] / b);
+		if(p->slot[CT_CYCLES] >= 0 && p->slot[CT_INSTR] >= 0)
+			fprintf(stderr, "\tipc=%.3f", v[CT_CYCLES] > 0 ? v[CT_INSTR] / v[CT_CYCLES] : 0);
+		fprintf(stderr, "\n");
+	}
+	/* per-state counts from a profiling build of the library */
+	for(st = jsb_stats(&n); n--; st++)
+		if(st->entries | st->bytes | st->yields)
+			fprintf(stderr, "state\t%s\tentries=%" PRIu64 "\tbytes=%" PRIu64 "\tyields=%" PRIu64 "\n",
+				st->name, st->entries, st->bytes, st->yields);
+	if(!p->nctr)
+		fprintf(stderr, "hardware counters unavailable, times only\n");
+	else if(p->user)
+		fprintf(stderr, "counters exclude kernel time\n");
+	if(p->leader >= 0)
+		close(p->leader);
+}
+
+/* jsb_update() as the parse phase, everything between calls is i/o */
+static size_t parse(jsb_t *jsb){
+	size_t rv;
+	prof_enter(&prof, PH_PARSE);
+	rv = jsb_update(jsb);
+	prof_enter(&prof, PH_IO);
+	return rv;
+}
+
+/* output goes out through write(), a shared mapping of the output file, or pages spliced into a pipe */
+enum { SINK_WRITE, SINK_MAP, SINK_SPLICE };
+
+typedef struct {
+	int fd, ofd, mode, cur;
+	uint8_t *buf[2];
+	size_t size, pre, wlen;
+	off_t off;
+} sink_t;
+
+/* set up the first output window of at least hint bytes, NULL on failure */
+static uint8_t *sink_init(sink_t *sk, int fd, size_t hint, size_t wlen){
+	struct stat st;
+	char path[32];
+	void *m;
+	int cap;
+	sk->fd = sk->ofd = fd;
+	sk->mode = SINK_WRITE;
+	sk->cur = 0;
+	sk->size = sk->wlen = wlen;
+	if(fd < 0 || fstat(fd, &st))
+		return sk->buf[0] = malloc(wlen);
+	if(S_ISREG(st.st_mode) && !(fcntl(fd, F_GETFL) & O_APPEND) && (sk->off = lseek(fd, 0, SEEK_CUR)) == st.st_size){
+		/* stdout is usually write-only, so reopen it for the shared mapping */
+		sprintf(path, "/proc/self/fd/%d", fd);
+		sk->fd = open(path, O_RDWR);
+		if(sk->fd >= 0){
+			sk->pre = sk->off % pgsz();
+			sk->size = hint;
+			m = MAP_FAILED;
+			/* reserve the blocks, as a sparse file would fault with SIGBUS once the disk fills */
+			if(!posix_fallocate(sk->fd, sk->off, hint))
+				m = mmap(NULL, sk->pre + hint, PROT_READ|PROT_WRITE, MAP_SHARED, sk->fd, sk->off - sk->pre);
+			if(MAP_FAILED != m){
+				madvise(m, sk->pre + hint, MADV_SEQUENTIAL);
+				sk->mode = SINK_MAP;
+				sk->buf[0] = m;
+				return sk->buf[0] + sk->pre;
+			}
+			if(ftruncate(sk->fd, sk->off))
+				return NULL;
+			close(sk->fd);
+		}
+		sk->fd = fd;
+		sk->size = wlen;
+	}
+	if(S_ISFIFO(st.st_mode) && (cap = fcntl(fd, F_GETPIPE_SZ)) > 0){
+		/*
+		 * Spliced pages stay referenced by the pipe until read, so alternate
+		 * two buffers, each large enough to push the other out of the pipe.
+		 */
+		if(sk->size < (size_t)cap)
+			sk->size = cap;
+		sk->size = page_round(sk->size);
+		m = mmap(NULL, 2 * sk->size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(MAP_FAILED != m){
+			sk->mode = SINK_SPLICE;
+			sk->buf[0] = m;
+			sk->buf[1] = sk->buf[0] + sk->size;
+			return sk->buf[0];
+		}
+		sk->size = wlen;
+	}
+	return sk->buf[0] = malloc(wlen);
+}
+
+static int fdsplice(int fd, const void *buf, size_t len){
+	struct iovec iov;
+	ssize_t w;
+	while(len){
+		iov.iov_base = (void *)buf;
+		iov.iov_len = len;
+		w = vmsplice(fd, &iov, 1, 0);
+		if(w < 0 && (EINTR == errno || EAGAIN == errno))
+			continue;
+		if(w <= 0)
+			return -1;
+		buf = w + (const uint8_t *)buf;
+		len -= w;
+	}
+	return 0;
+}
+
+/* drop the mapping, leaving the output file holding len bytes and positioned after them */
+static int sink_unmap(sink_t *sk, size_t len){
+	int r = 0;
+	munmap(sk->buf[0], sk->pre + sk->size);
+	if(ftruncate(sk->fd, sk->off + len) || lseek(sk->ofd, sk->off + len, SEEK_SET) < 0)
+		r = -1;
+	close(sk->fd);
+	sk->fd = sk->ofd;
+	return r;
+}
+
+/* pass on a full window and give the parser the next one */
+static int sink_next(sink_t *sk, jsb_t *jsb){
+	size_t grow;
+	void *m;
+	switch(sk->mode){
+		case SINK_MAP:
+			/* outgrew the estimate - extend the file and the mapping */
+			grow = sk->size;
+			if(!posix_fallocate(sk->fd, sk->off + sk->size, grow)){
+				m = mremap(sk->buf[0], sk->pre + sk->size, sk->pre + sk->size + grow, MREMAP_MAYMOVE);
+				if(MAP_FAILED == m)
+					return -1;
+				sk->buf[0] = m;
+				jsb->next_out = sk->buf[0] + sk->pre + sk->size;
+				jsb->avail_out = grow;
+				sk->size += grow;
+				return 0;
+			}
+			/* no room to reserve - keep what is mapped and carry on through write() */
+			sk->mode = SINK_WRITE;
+			sk->buf[0] = sink_unmap(sk, sk->size) ? NULL : malloc(sk->wlen);
+			sk->size = sk->wlen;
+			if(!sk->buf[0])
+				return -1;
+			break;
+		case SINK_SPLICE:
+			if(fdsplice(sk->fd, sk->buf[sk->cur], sk->size))
+				return -1;
+			sk->cur ^= 1;
+			break;
+		default:
+			if(sk->fd >= 0 && fdwrite(sk->fd, sk->buf[0], sk->size))
+				return -1;
+	}
+	jsb->next_out = sk->buf[sk->cur];
+	jsb->avail_out = sk->size;
+	return 0;
+}
+
+/* flush the last window unless failed, trimming a mapped file to the bytes produced */
+static int sink_fini(sink_t *sk, jsb_t *jsb, int failed){
+	const uint8_t *b = sk->buf[sk->cur];
+	size_t len;
+	int r = 0;
+	switch(sk->mode){
+		case SINK_MAP:
+			len = failed ? 0 : (size_t)(jsb->next_out - (b + sk->pre));
+			return sink_unmap(sk, len);
+		case SINK_SPLICE:
+			if(!failed)
+				r = fdsplice(sk->fd, b, jsb->next_out - b);
+			munmap(sk->buf[0], 2 * sk->size);
+			return r;
+		default:
+			if(sk->fd >= 0 && !failed)
+				r = fdwrite(sk->fd, b, jsb->next_out - b);
+			free(sk->buf[0]);
+			return r;
+	}
+}
+
+#if URING
+/* minimal io_uring plumbing via raw syscalls */
+typedef struct {
+	int fd, fixed;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_map, *cq_map;
+	size_t sq_size, cq_size, sqe_size;
+	unsigned queued;
+} uring_t;
+
+static void uring_fini(uring_t *u){
+	if(u->sqes != MAP_FAILED)
+		munmap(u->sqes, u->sqe_size);
+	if(u->cq_map != MAP_FAILED && u->cq_map != u->sq_map)
+		munmap(u->cq_map, u->cq_size);
+	if(u->sq_map != MAP_FAILED)
+		munmap(u->sq_map, u->sq_size);
+	close(u->fd);
+}
+
+/* set up a ring with buf registered as its one fixed buffer, return -1 if unavailable */
+static int uring_init(uring_t *u, unsigned entries, void *buf, size_t len){
+	struct io_uring_params p;
+	struct iovec iov;
+	uint8_t *sq, *cq;
+	memset(&p, 0, sizeof(p));
+	u->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if(u->fd < 0)
+		return -1;
+	u->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	u->sqe_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	if((p.features & IORING_FEAT_SINGLE_MMAP) && u->cq_size > u->sq_size)
+		u->sq_size = u->cq_size;
+	u->sq_map = mmap(NULL, u->sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	u->cq_map = (p.features & IORING_FEAT_SINGLE_MMAP) ? u->sq_map
+		: mmap(NULL, u->cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+	u->sqes = mmap(NULL, u->sqe_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if(MAP_FAILED == u->sq_map || MAP_FAILED == u->cq_map || MAP_FAILED == u->sqes){
+		uring_fini(u);
+		return -1;
+	}
+	sq = u->sq_map;
+	cq = u->cq_map;
+	u->sq_head = (unsigned *)(sq + p.sq_off.head);
+	u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)(sq + p.sq_off.array);
+	u->cq_head = (unsigned *)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	u->queued = 0;
+	/* fixed buffers save the per-request page pinning, plain ops work without */
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	u->fixed = !syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS, &iov, 1);
+	return 0;
+}
+
+/* queue a read or write, off of -1 uses (and advances) the file position */
+static void uring_prep(uring_t *u, int wr, int fd, void *buf, size_t len, uint64_t off, uint64_t data){
+	unsigned tail = *u->sq_tail, i = tail & *u->sq_mask;
+	struct io_uring_sqe *sqe = u->sqes + i;
+	memset(sqe, 0, sizeof(*sqe));
+	if(u->fixed)
+		sqe->opcode = wr ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+	else
+		sqe->opcode = wr ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = len;
+	sqe->off = off;
+	sqe->user_data = data;
+	u->sq_array[i] = i;
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	u->queued++;
+}
+
+/* submit queued requests, optionally waiting for a completion */
+static int uring_enter(uring_t *u, int wait){
+	long r;
+	do{
+		r = syscall(__NR_io_uring_enter, u->fd, u->queued, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	}while(r < 0 && (EINTR == errno || EAGAIN == errno || EBUSY == errno));
+	if(r > 0)
+		u->queued -= r;
+	return r < 0 ? -1 : 0;
+}
+
+static int uring_reap(uring_t *u, uint64_t *data, int *res){
+	unsigned head = *u->cq_head;
+	struct io_uring_cqe *cqe;
+	if(head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+	cqe = u->cqes + (head & *u->cq_mask);
+	*data = cqe->user_data;
+	*res = cqe->res;
+	__atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+#define NBUF 4
+
+enum { FREE, FILLING, FILLED, BUSY };
+
+typedef struct {
+	uint8_t *data;
+	size_t len, done;
+	uint64_t off;
+	int state;
+} ubuf_t;
+
+/*
+ * Convert ifd to ofd keeping up to NBUF reads and writes in flight.
+ * Seekable files get explicit offsets and overlapping requests, pipes one
+ * request each way at a time. Returns -1 if no ring could be set up
+ * (nothing has been read), 1 on failure, 0 once all output is written.
+ */
+static int uring_run(int ifd, int ofd, jsb_t *jsb, size_t jsz, uint32_t flags, int emit, size_t rlen, size_t wlen){
+	uring_t u;
+	ubuf_t in[NBUF], out[NBUF], *b;
+	struct stat st;
+	uint8_t *mem;
+	size_t isz = page_round(rlen / NBUF), osz = page_round(wlen / NBUF), memsz = NBUF * (isz + osz), rv = JSB_OK;
+	uint64_t ioff = 0, ooff = 0, isize = 0, data;
+	unsigned ih = 0, it = 0, ot = 0, os = 0, iflight = 0, oflight = 0, i;
+	int iseek = 0, oseek = 0, iend = 0, eof = 0, started = 0, active = 0, nl = 0, ret = 1, wait = 0, res;
+	off_t o;
+
+	mem = mmap(NULL, memsz, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(MAP_FAILED == mem)
+		return -1;
+	if(uring_init(&u, 2 * NBUF, mem, memsz)){
+		munmap(mem, memsz);
+		return -1;
+	}
+	for(i = 0; i < NBUF; i++){
+		in[i].data = mem + i * isz;
+		out[i].data = mem + NBUF * isz + i * osz;
+		in[i].state = out[i].state = FREE;
+	}
+	if(!fstat(ifd, &st) && S_ISREG(st.st_mode) && (o = lseek(ifd, 0, SEEK_CUR)) >= 0){
+		iseek = 1;
+		ioff = o;
+		isize = st.st_size;
+		/* files learn of the end from their size, pipes from a zero-length read */
+		iend = ioff >= isize;
+	}
+	if(!fstat(ofd, &st) && S_ISREG(st.st_mode) && (o = lseek(ofd, 0, SEEK_CUR)) >= 0 && !(fcntl(ofd, F_GETFL) & O_APPEND)){
+		oseek = 1;
+		ooff = o;
+	}
+
+	while(1){
+		/* keep reads queued ahead of the parser */
+		while(!iend && it - ih < NBUF && (iseek || !iflight)){
+			b = in + it % NBUF;
+			b->len = b->done = 0;
+			b->off = ioff;
+			b->state = BUSY;
+			uring_prep(&u, 0, ifd, b->data, isz, iseek ? ioff : (uint64_t)-1, it % NBUF);
+			it++;
+			iflight++;
+			if(iseek && (ioff += isz) >= isize)
+				iend = 1;
+		}
+		/* write out filled buffers in order */
+		while(os != ot && (oseek || !oflight)){
+			b = out + os % NBUF;
+			b->done = 0;
+			b->off = ooff;
+			b->state = BUSY;
+			uring_prep(&u, 1, ofd, b->data, b->len, oseek ? ooff : (uint64_t)-1, NBUF + os % NBUF);
+			ooff += b->len;
+			os++;
+			oflight++;
+		}
+		/* only block once everything pending has been submitted */
+		if((u.queued || wait) && uring_enter(&u, wait))
+			goto fail;
+		while(uring_reap(&u, &data, &res)){
+			if(data < NBUF){
+				b = in + data;
+				if(res < 0){
+					if(-EINTR != res && -EAGAIN != res)
+						goto fail;
+				}else{
+					b->len += res;
+				}
+				/* file reads should only come back short at the end, but check anyway */
+				if(iseek && (res < 0 || (res > 0 && b->len < isz && b->off + b->len < isize))){
+					uring_prep(&u, 0, ifd, b->data + b->len, isz - b->len, b->off + b->len, data);
+				}else if(!iseek && res < 0){
+					uring_prep(&u, 0, ifd, b->data, isz, (uint64_t)-1, data);
+				}else{
+					b->state = FILLED;
+					iflight--;
+					if(!res && !iseek)
+						iend = 1;
+				}
+			}else{
+				b = out + (data - NBUF);
+				if(res <= 0){
+					if(!res || (-EINTR != res && -EAGAIN != res))
+						goto fail;
+					res = 0;
+				}
+				b->done += res;
+				if(b->done < b->len){
+					uring_prep(&u, 1, ofd, b->data + b->done, b->len - b->done, oseek ? b->off + b->done : (uint64_t)-1, data);
+				}else{
+					b->state = FREE;
+					oflight--;
+				}
+			}
+		}
+		if(JSB_OK != rv){
+			/* drain remaining writes */
+			if(!oflight && os == ot)
+				break;
+			wait = 1;
+			continue;
+		}
+		wait = 0;
+		/* hand the parser its next input buffer */
+		if((!started || !jsb->avail_in) && !eof){
+			if(active){
+				in[ih++ % NBUF].state = FREE;
+				active = 0;
+			}
+			b = in + ih % NBUF;
+			if(ih != it && BUSY == b->state){
+				wait = 1;
+			}else if(ih == it && !iend){
+				wait = 1;
+			}else{
+				if(!started){
+					if(ih != it && b->len && !sniff(b->data[0], &flags))
+						goto fail;
+					jsb_init(jsb, flags, jsz);
+					started = 1;
+				}
+				if(ih == it || !b->len){
+					jsb_eof(jsb);
+					eof = 1;
+				}else{
+					jsb->next_in = b->data;
+					jsb->avail_in = b->len;
+					active = 1;
+				}
+			}
+		}
+		/* and somewhere to put its output */
+		if(started && !jsb->avail_out){
+			b = out + ot % NBUF;
+			if(FILLING == b->state){
+				if(emit){
+					b->len = osz;
+					b->state = FILLED;
+					ot++;
+				}else{
+					b->state = FREE;
+				}
+				b = out + ot % NBUF;
+			}
+			if(FREE == b->state){
+				b->state = FILLING;
+				jsb->next_out = b->data;
+				jsb->avail_out = osz;
+			}else{
+				wait = 1;
+			}
+		}
+		if(wait)
+			continue;
+		rv = parse(jsb);
+		if(JSB_OK == rv)
+			continue;
+		if(JSB_ERROR == rv || jsb->avail_in)
+			goto fail;
+		/* finished - queue the tail of the output */
+		b = out + ot % NBUF;
+		if(emit && FILLING == b->state){
+			b->len = jsb->next_out - b->data;
+			if((flags & JSB_REVERSE) && !(flags & JSB_LINES)){
+				if(jsb->avail_out)
+					b->data[b->len++] = '\n';
+				else
+					nl = 1; /* no room, written after the rest */
+			}
+			b->state = FILLED;
+			ot++;
+		}
+	}
+	/* leave the file offset where plain writes would have */
+	if(oseek && lseek(ofd, ooff, SEEK_SET) < 0)
+		goto fail;
+	if(nl && fdwrite(ofd, "\n", 1))
+		goto fail;
+	ret = 0;
+fail:
+	uring_fini(&u);
+	munmap(mem, memsz);
+	return ret;
+}
+#endif
+
+/* single-producer single-consumer ring of n equally sized buffers */
+typedef struct {
+	uint8_t *mem;
+	size_t size, *len;
+	unsigned n, head, tail;
+	int sleeping[2], err;
+	pthread_mutex_t mu;
+	pthread_cond_t cv[2];
+} ring_t;
+
+static int ring_init(ring_t *r, unsigned n, size_t size){
+	r->mem = malloc(n * size);
+	r->len = malloc(n * sizeof(*r->len));
+	r->size = size;
+	r->n = n;
+	r->head = r->tail = 0;
+	r->sleeping[0] = r->sleeping[1] = r->err = 0;
+	pthread_mutex_init(&r->mu, NULL);
+	pthread_cond_init(&r->cv[0], NULL);
+	pthread_cond_init(&r->cv[1], NULL);
+	return r->mem && r->len ? 0 : -1;
+}
+
+static void ring_fini(ring_t *r){
+	pthread_cond_destroy(&r->cv[0]);
+	pthread_cond_destroy(&r->cv[1]);
+	pthread_mutex_destroy(&r->mu);
+	free(r->len);
+	free(r->mem);
+}
+
+static int ring_ready(ring_t *r, int put){
+	if(put)
+		return r->tail - __atomic_load_n(&r->head, __ATOMIC_SEQ_CST) < r->n;
+	return __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) != r->head;
+}
+
+/* spin briefly, then sleep until a slot is free (put) or filled (get) */
+static uint8_t *ring_wait(ring_t *r, int put){
+	unsigned spin;
+	for(spin = 0; spin < 1024 && !ring_ready(r, put); spin++)
+		;
+	if(spin == 1024){
+		pthread_mutex_lock(&r->mu);
+		__atomic_store_n(&r->sleeping[put], 1, __ATOMIC_SEQ_CST);
+		while(!ring_ready(r, put))
+			pthread_cond_wait(&r->cv[put], &r->mu);
+		__atomic_store_n(&r->sleeping[put], 0, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&r->mu);
+	}
+	return r->mem + (put ? r->tail : r->head) % r->n * r->size;
+}
+
+/* pass a slot to the other side: filled (put) with len bytes, or emptied (get) */
+static void ring_post(ring_t *r, int put, size_t len){
+	if(put){
+		r->len[r->tail % r->n] = len;
+		__atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_SEQ_CST);
+	}else{
+		__atomic_store_n(&r->head, r->head + 1, __ATOMIC_SEQ_CST);
+	}
+	/* wake the other side if it went to sleep */
+	if(__atomic_load_n(&r->sleeping[!put], __ATOMIC_SEQ_CST)){
+		pthread_mutex_lock(&r->mu);
+		pthread_cond_signal(&r->cv[!put]);
+		pthread_mutex_unlock(&r->mu);
+	}
+}
+
+typedef struct {
+	ring_t *ring;
+	int fd;
+} stage_t;
+
+/* reader thread - a zero-length slot marks the end of input */
+static void *pipe_reader(void *arg){
+	stage_t *s = arg;
+	ring_t *r = s->ring;
+	uint8_t *buf;
+	ssize_t n;
+	do{
+		buf = ring_wait(r, 1);
+		while((n = read(s->fd, buf, r->size)) < 0 && (EINTR == errno || EAGAIN == errno))
+			;
+		if(n < 0){
+			r->err = 1;
+			n = 0;
+		}
+		ring_post(r, 1, n);
+	}while(n);
+	return NULL;
+}
+
+/* writer thread - keeps draining after a failed write so the converter never stalls */
+static void *pipe_writer(void *arg){
+	stage_t *s = arg;
+	ring_t *r = s->ring;
+	uint8_t *buf;
+	size_t n;
+	do{
+		buf = ring_wait(r, 0);
+		n = r->len[r->head % r->n];
+		if(n && !r->err && fdwrite(s->fd, buf, n))
+			r->err = 1;
+		ring_post(r, 0, 0);
+	}while(n);
+	return NULL;
+}
+
+/*
+ * Convert ifd to ofd with reading and writing on their own threads, each
+ * linked to the converter by a ring of n buffers. Returns 0 once all output
+ * is written.
+ */
+static int pipe_run(int ifd, int ofd, jsb_t *jsb, size_t jsz, uint32_t flags, int emit, unsigned n, size_t rlen, size_t wlen){
+	/* static, as a reader blocked on a pipe may outlive the call */
+	static ring_t in, out;
+	static stage_t rd, wr;
+	pthread_t rt, wt;
+	uint8_t *ib, *ob;
+	size_t rv, len;
+	int eof = 0;
+
+	/* input windows are whole pages, as with block_init() */
+	rlen = page_round(rlen);
+	if(ring_init(&in, n, rlen) || ring_init(&out, emit ? n : 1, wlen))
+		return 1;
+	rd.ring = &in;
+	rd.fd = ifd;
+	wr.ring = &out;
+	wr.fd = ofd;
+	if(pthread_create(&rt, NULL, pipe_reader, &rd))
+		return 1;
+	if(emit && pthread_create(&wt, NULL, pipe_writer, &wr))
+		return 1;
+
+	ib = ring_wait(&in, 0);
+	len = in.len[in.head % in.n];
+	if(len && !sniff(*ib, &flags))
+		return 1;
+	jsb_init(jsb, flags, jsz);
+	ob = ring_wait(&out, 1);
+	jsb->next_out = ob;
+	jsb->avail_out = wlen;
+	jsb->next_in = ib;
+	jsb->avail_in = len;
+	if(!len){
+		jsb_eof(jsb);
+		eof = 1;
+	}
+
+	rv = parse(jsb);
+	while(JSB_OK == rv){
+		if(!jsb->avail_out){
+			if(emit){
+				ring_post(&out, 1, wlen);
+				ob = ring_wait(&out, 1);
+			}
+			jsb->next_out = ob;
+			jsb->avail_out = wlen;
+		}
+		if(!jsb->avail_in && !eof){
+			ring_post(&in, 0, 0);
+			jsb->next_in = ring_wait(&in, 0);
+			jsb->avail_in = in.len[in.head % in.n];
+			if(!jsb->avail_in){
+				jsb_eof(jsb);
+				eof = 1;
+			}
+		}
+		rv = parse(jsb);
+	}
+	/* on failure the caller exits, taking the threads with it */
+	if(JSB_ERROR == rv || jsb->avail_in || in.err)
+		return 1;
+	if(emit){
+		len = jsb->next_out - ob;
+		if((flags & JSB_REVERSE) && !(flags & JSB_LINES)){
+			if(!jsb->avail_out){
+				ring_post(&out, 1, len);
+				ob = ring_wait(&out, 1);
+				len = 0;
+			}
+			ob[len++] = '\n';
+		}
+		if(len)
+			ring_post(&out, 1, len);
+		ring_wait(&out, 1);
+		ring_post(&out, 1, 0);
+		pthread_join(wt, NULL);
+		if(out.err)
+			return 1;
+	}
+	/* output is complete, even if the reader is still stuck in read() */
+	if(eof){
+		pthread_join(rt, NULL);
+		ring_fini(&in);
+	}
+	ring_fini(&out);
+	return 0;
+}
+
+/* -j: whole JSB_LINES binary is cut at record ends into segments that workers convert
+ * in any order, while the caller writes them out in order - workers stay at most two
+ * segments each ahead of the writer to bound memory
+ */
+enum { SEG_WAIT, SEG_DONE, SEG_FAILED };
+
+typedef struct {
+	const uint8_t *src;
+	size_t *cuts;
+	size_t nseg, next, written, ahead, jsz;
+	uint8_t **out;
+	size_t *len;
+	int *state;
+	uint32_t flags;
+	int stop;
+	unsigned live;
+	pthread_mutex_t mu;
+	pthread_cond_t cv;
+} par_t;
+
+/* convert one segment into a buffer grown as needed */
+static uint8_t *par_convert(par_t *p, jsb_t *jsb, size_t i, size_t *len){
+	const size_t start = i ? p->cuts[i - 1] : 0;
+	size_t rv, size = (p->cuts[i] - start) * 3 / 2 + 64;
+	uint8_t *buf = malloc(size), *t;
+	if(!buf)
+		return NULL;
+	jsb_init(jsb, p->flags | JSB_EOF, p->jsz);
+	jsb->next_in = p->src + start;
+	jsb->avail_in = p->cuts[i] - start;
+	jsb->next_out = buf;
+	jsb->avail_out = size;
+	while(JSB_OK == (rv = jsb_update(jsb)) && !jsb->avail_out){
+		if(!(t = realloc(buf, 2 * size)))
+			break;
+		jsb->next_out = t + size;
+		jsb->avail_out = size;
+		buf = t;
+		size *= 2;
+	}
+	if(JSB_DONE != rv || jsb->avail_in){
+		free(buf);
+		return NULL;
+	}
+	*len = jsb->total_out;
+	return buf;
+}
+
+static void *par_worker(void *arg){
+	par_t *p = arg;
+	jsb_t *jsb = malloc(p->jsz);
+	uint8_t *buf;
+	size_t i, len = 0;
+	while(jsb){
+		pthread_mutex_lock(&p->mu);
+		while(!p->stop && p->next < p->nseg && p->next >= p->written + p->ahead)
+			pthread_cond_wait(&p->cv, &p->mu);
+		if(p->stop || p->next == p->nseg){
+			pthread_mutex_unlock(&p->mu);
+			break;
+		}
+		i = p->next++;
+		pthread_mutex_unlock(&p->mu);
+		buf = par_convert(p, jsb, i, &len);
+		pthread_mutex_lock(&p->mu);
+		p->out[i] = buf;
+		p->len[i] = len;
+		p->state[i] = buf ? SEG_DONE : SEG_FAILED;
+		/* segments past a failed one are never written */
+		p->stop |= !buf;
+		pthread_cond_broadcast(&p->cv);
+		pthread_mutex_unlock(&p->mu);
+	}
+	free(jsb);
+	pthread_mutex_lock(&p->mu);
+	p->live--;
+	pthread_cond_broadcast(&p->cv);
+	pthread_mutex_unlock(&p->mu);
+	return NULL;
+}
+
+static int par_run(const uint8_t *src, size_t len, int ofd, size_t jsz, uint32_t flags, int emit, unsigned n, size_t rlen){
+	par_t p;
+	pthread_t *th = calloc(n, sizeof(*th));
+	size_t i, nseg = len / (rlen ? rlen : 1) + n;
+	unsigned k, started;
+	int ret = 1;
+	memset(&p, 0, sizeof(p));
+	p.cuts = malloc(nseg * sizeof(*p.cuts));
+	p.out = calloc(nseg, sizeof(*p.out));
+	p.len = calloc(nseg, sizeof(*p.len));
+	p.state = calloc(nseg, sizeof(*p.state));
+	if(!th || !p.cuts || !p.out || !p.len || !p.state)
+		goto fail;
+	p.src = src;
+	p.nseg = jsb_split(src, len, p.cuts, nseg);
+	p.ahead = 2 * n;
+	p.jsz = jsz;
+	p.flags = flags;
+	pthread_mutex_init(&p.mu, NULL);
+	pthread_cond_init(&p.cv, NULL);
+	pthread_mutex_lock(&p.mu);
+	for(started = 0; started < n && !pthread_create(th + started, NULL, par_worker, &p); started++)
+		p.live++;
+	pthread_mutex_unlock(&p.mu);
+	for(i = 0; i < p.nseg; i++){
+		/* a segment nobody is left to convert counts as failed */
+		pthread_mutex_lock(&p.mu);
+		while(SEG_WAIT == p.state[i] && p.live)
+			pthread_cond_wait(&p.cv, &p.mu);
+		pthread_mutex_unlock(&p.mu);
+		if(SEG_DONE != p.state[i] || (emit && fdwrite(ofd, p.out[i], p.len[i])))
+			break;
+		free(p.out[i]);
+		p.out[i] = NULL;
+		pthread_mutex_lock(&p.mu);
+		p.written++;
+		pthread_cond_broadcast(&p.cv);
+		pthread_mutex_unlock(&p.mu);
+	}
+	ret = (i != p.nseg);
+	pthread_mutex_lock(&p.mu);
+	p.stop = 1;
+	pthread_cond_broadcast(&p.cv);
+	pthread_mutex_unlock(&p.mu);
+	for(k = 0; k < started; k++)
+		pthread_join(th[k], NULL);
+	pthread_cond_destroy(&p.cv);
+	pthread_mutex_destroy(&p.mu);
+fail:
+	for(i = 0; p.out && i < nseg; i++)
+		free(p.out[i]);
+	free(p.out);
+	free(p.len);
+	free(p.state);
+	free(p.cuts);
+	free(th);
+	return ret;
+}
+
+/* record table of whole binary input, reused from path when it ends where the input
+ * does, otherwise built in one pass (and saved to path), NULL on failure
+ */
+static size_t *records(const uint8_t *src, size_t len, const char *path, size_t *n){
+	size_t *ends = NULL, cap = 0, i, last = len;
+	struct stat st;
+	ssize_t r;
+	int fd = -1;
+	*n = 0;
+	while(last && JSB_DOC_END != src[last - 1])
+		last--;
+	if(path){
+		fd = open(path, O_RDWR | O_CREAT, 0666);
+		if(fd < 0 || fstat(fd, &st))
+			goto fail;
+		if(st.st_size > 0 && !(st.st_size % sizeof(size_t)) && (ends = malloc(st.st_size))){
+			for(i = 0; i < (size_t)st.st_size; i += r)
+				if((r = pread(fd, (uint8_t *)ends + i, st.st_size - i, i)) <= 0)
+					break;
+			cap = (i == (size_t)st.st_size) ? i / sizeof(size_t) : 0;
+			/* each entry must end a record of this input, so a table saved for another is rebuilt */
+			for(i = 0; i < cap && ends[i] && ends[i] <= last && (!i || ends[i - 1] < ends[i]) && JSB_DOC_END == src[ends[i] - 1]; i++);
+			if(cap && i == cap && ends[cap - 1] == last){
+				*n = cap;
+				close(fd);
+				return ends;
+			}
+		}
+	}
+	do{
+		if(*n == cap){
+			size_t *t = realloc(ends, (cap = cap ? 2 * cap : 65536) * sizeof(size_t));
+			if(!t)
+				goto fail;
+			ends = t;
+		}
+		*n += jsb_records(src, *n ? ends[*n - 1] : 0, len, ends + *n, cap - *n);
+	}while(*n == cap);
+	if(fd >= 0){
+		if(ftruncate(fd, 0) || fdwrite(fd, ends, *n * sizeof(size_t)))
+			goto fail;
+		close(fd);
+	}
+	return ends;
+fail:
+	if(fd >= 0)
+		close(fd);
+	free(ends);
+	return NULL;
+}
+
+/* room for n more bytes past len in a growing buffer, 0 on success */
+static int reserve(uint8_t **buf, size_t len, size_t *cap, size_t n){
+	uint8_t *t;
+	if(*cap - len >= n)
+		return 0;
+	if(!(t = realloc(*buf, 2 * (len + n))))
+		return -1;
+	*buf = t;
+	*cap = 2 * (len + n);
+	return 0;
+}
+
+static int append(uint8_t **buf, size_t *len, size_t *cap, const uint8_t *src, size_t n){
+	if(reserve(buf, *len, cap, n))
+		return -1;
+	memcpy(*buf + *len, src, n);
+	*len += n;
+	return 0;
+}
+
+typedef int (*run_fn)(void *ctx, const uint8_t *run, size_t len);
+
+/* hand whole records of binary input to fn a run at a time - all of a mapped file at once,
+ * or each block as it is read, holding a partial record back until the block that ends it
+ * return 0, or -1 if fn fails, memory runs out, or input ends within a record
+ */
+static int each_run(block_t *bk, const uint8_t *src, size_t len, run_fn fn, void *ctx){
+	uint8_t *carry = NULL;
+	size_t clen = 0, ccap = 0, k, cut;
+	int r = 0;
+	while(len && !r){
+		/* the held record ends at the first JSB_DOC_END, the run at the last */
+		k = 0;
+		if(clen && !jsb_records(src, 0, len, &k, 1))
+			k = len;
+		for(cut = len; cut > k && JSB_DOC_END != src[cut - 1]; cut--);
+		if(k && !(r = append(&carry, &clen, &ccap, src, k)) && JSB_DOC_END == carry[clen - 1]){
+			r = fn(ctx, carry, clen);
+			clen = 0;
+		}
+		if(!r && cut > k)
+			r = fn(ctx, src + k, cut - k);
+		if(!r && len > cut)
+			r = append(&carry, &clen, &ccap, src + cut, len - cut);
+		len = bk->state ? block_next(bk) : 0;
+		src = bk->data;
+	}
+	if(!r && clen)
+		r = -1;
+	free(carry);
+	return r;
+}
+
+/* the same for JSON input, converted to binary a buffer (of wlen bytes, or one record) at a time */
+static int json_runs(jsb_t *jsb, size_t jsz, block_t *bk, const uint8_t *src, size_t len, uint32_t flags, size_t wlen, run_fn fn, void *ctx){
+	uint8_t *buf = malloc(wlen), *t;
+	size_t size = wlen, used, cut, rv;
+	int r = -1;
+	jsb_init(jsb, flags | JSB_LINES, jsz);
+	jsb->next_in = src;
+	jsb->avail_in = len;
+	jsb->next_out = buf;
+	jsb->avail_out = size;
+	while(buf){
+		rv = parse(jsb);
+		if(JSB_ERROR == rv)
+			break;
+		/* pass on whole records, keeping back the one still being written */
+		used = jsb->next_out - buf;
+		for(cut = used; cut && JSB_DOC_END != buf[cut - 1]; cut--);
+		if(cut && fn(ctx, buf, cut))
+			break;
+		memmove(buf, buf + cut, used - cut);
+		used -= cut;
+		if(used == size){
+			if(!(t = realloc(buf, 2 * size)))
+				break;
+			buf = t;
+			size *= 2;
+		}
+		jsb->next_out = buf + used;
+		jsb->avail_out = size - used;
+		if(JSB_DONE == rv){
+			r = (jsb->avail_in || used) ? -1 : 0;
+			break;
+		}
+		if(!jsb->avail_in){
+			jsb->next_in = bk->data;
+			jsb->avail_in = bk->state ? block_next(bk) : 0;
+			if(!jsb->avail_in)
+				jsb_eof(jsb);
+		}
+	}
+	free(buf);
+	return r;
+}
+
+/* dotted path from the command line (e.g. .user.id) as a jsb_path_get() path, in place */
+static char *path_arg(char *s){
+	char *c;
+	if('.' == *s)
+		s++;
+	for(c = s; *c; c++)
+		if('.' == *c)
+			*c = (char)JSB_KEY;
+	return s;
+}
+
+/* -f PATH OP VALUE, where OP is one of == != < <= > >= and VALUE is JSON, or just PATH
+ * for a value being there, as a predicate term
+ */
+static int pred_arg(jsb_pred_t *p, char *arg){
+	static const char *ops[] = { "==", "!=", "<=", ">=", "<", ">" };
+	static const uint32_t codes[] = { JSB_PRED_EQ, JSB_PRED_NE, JSB_PRED_LE, JSB_PRED_GE, JSB_PRED_LT, JSB_PRED_GT, JSB_PRED_HAS };
+	char *op = arg + strcspn(arg, "=<>!"), *val, *e;
+	uint8_t *bin = NULL;
+	size_t i, n;
+	for(i = 0; i < 6 && strncmp(op, ops[i], strlen(ops[i])); i++);
+	if(6 == i && *op)
+		return -1;
+	if(6 != i){
+		val = op + strlen(ops[i]);
+		n = strlen(val);
+		if(!(bin = malloc(n + 2)) || JSB_ERROR == jsb(bin, n + 2, val, n, 0, -1)){
+			free(bin);
+			return -1;
+		}
+	}
+	for(e = op; e != arg && ' ' == e[-1]; e--);
+	*e = 0;
+	p->path = path_arg(arg);
+	p->pathlen = -1;
+	p->op = codes[i];
+	p->base = bin;
+	p->offset = 0;
+	return 0;
+}
+
+/* -A/-f: aggregates of one path over the records passing every -f term, or those records
+ * themselves, with each run cut across jobs threads
+ */
+typedef struct {
+	const char *path;   /* -A, or NULL to write out matching records */
+	const jsb_pred_t *pred;
+	size_t npred;
+	jsb_filter_t filter;
+	unsigned jobs;
+	int ofd;            /* where matching records go, or -1 */
+	uint32_t oflags;    /* converting them to JSON, or zero to copy binary */
+	size_t jsz;
+	uint64_t records, bytes;
+	jsb_agg_t agg;
+} query_t;
+
+typedef struct {
+	const query_t *q;
+	const uint8_t *run;
+	size_t off, len, ret;
+	jsb_agg_t agg;
+	uint8_t *out;
+	size_t olen, ocap;
+} part_t;
+
+/* add run[s, e), whole records, to the part's output */
+static int qry_emit(part_t *p, jsb_t *jsb, size_t s, size_t e){
+	size_t rv;
+	if(!p->q->oflags)
+		return append(&p->out, &p->olen, &p->ocap, p->run + s, e - s);
+	jsb_init(jsb, p->q->oflags | JSB_EOF, p->q->jsz);
+	jsb->next_in = p->run + s;
+	jsb->avail_in = e - s;
+	do{
+		if(reserve(&p->out, p->olen, &p->ocap, (e - s) / 2 + 64))
+			return -1;
+		jsb->next_out = p->out + p->olen;
+		jsb->avail_out = p->ocap - p->olen;
+		rv = jsb_update(jsb);
+		p->olen = p->ocap - jsb->avail_out;
+	}while(JSB_OK == rv && !jsb->avail_out);
+	return (JSB_DONE == rv && !jsb->avail_in) ? 0 : -1;
+}
+
+static void *qry_part(void *arg){
+	part_t *p = arg;
+	const query_t *q = p->q;
+	size_t hits[2 * 256], off = p->off, n, i, j;
+	jsb_t *jsb = NULL;
+	if(q->path){
+		p->ret = jsb_aggregate(p->run, p->off, p->len, NULL, q->path, -1, q->pred, q->npred, &p->agg);
+		return NULL;
+	}
+	p->ret = (q->oflags && !(jsb = malloc(q->jsz))) ? JSB_ERROR : 0;
+	while(off != p->len && JSB_ERROR != p->ret){
+		n = jsb_filter(&q->filter, p->run, &off, p->len, NULL, hits, 256);
+		if(JSB_ERROR == n)
+			p->ret = n;
+		/* neighbouring matches go out together */
+		for(i = 0; i < n && JSB_ERROR != p->ret; i = j){
+			for(j = i + 1; j < n && hits[2 * j] == hits[2 * j - 1]; j++);
+			if(qry_emit(p, jsb, hits[2 * i], hits[2 * j - 1]))
+				p->ret = JSB_ERROR;
+		}
+	}
+	free(jsb);
+	return NULL;
+}
+
+static int qry_run(void *ctx, const uint8_t *run, size_t len){
+	query_t *q = ctx;
+	size_t *cuts = malloc(q->jobs * sizeof(*cuts)), i, n = 0;
+	part_t *part = calloc(q->jobs, sizeof(*part));
+	pthread_t *th = calloc(q->jobs, sizeof(*th));
+	unsigned started;
+	int ret = -1;
+	if(cuts && part && th){
+		n = jsb_split(run, len, cuts, q->jobs);
+		for(i = 0; i < n; i++){
+			part[i].q = q;
+			part[i].run = run;
+			part[i].off = i ? cuts[i - 1] : 0;
+			part[i].len = cuts[i];
+		}
+		/* the first part runs here, as do any that no thread could be started for */
+		for(started = 1; started < n && !pthread_create(th + started, NULL, qry_part, part + started); started++);
+		for(i = started; i < n; i++)
+			qry_part(part + i);
+		qry_part(part);
+		for(i = 1; i < started; i++)
+			pthread_join(th[i], NULL);
+		/* parts are merged, or written out, in order */
+		for(ret = 0, i = 0; i < n && !ret; i++){
+			if(JSB_ERROR == part[i].ret || (q->ofd >= 0 && part[i].olen && fdwrite(q->ofd, part[i].out, part[i].olen)))
+				ret = -1;
+			else
+				q->records += part[i].ret;
+			jsb_agg_merge(&q->agg, &part[i].agg);
+		}
+		q->bytes += len;
+	}
+	for(i = 0; part && i < n; i++)
+		free(part[i].out);
+	free(cuts);
+	free(part);
+	free(th);
+	return ret;
+}
+
+/* ,"name":number - exact integers until a number was not one, null without any numbers */
+static char *agg_num(char *s, const char *name, const jsb_agg_t *a, int64_t i, double d){
+	uint8_t num[JSB_FMT_MAX];
+	size_t n = a->inexact ? jsb_fmt_f64(num, d) : jsb_fmt_i64(num, i);
+	s += sprintf(s, ",\"%s\":", name);
+	if(!a->count || JSB_ERROR == n)
+		return s + sprintf(s, "null");
+	memcpy(s, num + 1, n - 1);
+	return s + n - 1;
+}
+
+static int agg_print(int fd, const query_t *q){
+	const jsb_agg_t *a = &q->agg;
+	char out[128 + 3 * JSB_FMT_MAX], *s = out;
+	s += sprintf(s, "{\"records\":%" PRIu64 ",\"matched\":%" PRIu64 ",\"count\":%" PRIu64, q->records, a->rows, a->count);
+	s = agg_num(s, "sum", a, a->isum, a->sum);
+	s = agg_num(s, "min", a, a->imin, a->min);
+	s = agg_num(s, "max", a, a->imax, a->max);
+	s += sprintf(s, "}\n");
+	return fdwrite(fd, out, s - out);
+}
+
+/* -t prints throughput from clock(), -T the per-phase report */
+static void timing(int timeit, clock_t t0, uint64_t bytes){
+	clock_t t1 = clock();
+	if(1 == timeit)
+		fprintf(stderr, "%.3f mb/sec\n", bytes * (CLOCKS_PER_SEC / 1048576.0) / (t1 - t0));
+	else if(timeit)
+		prof_report(&prof, bytes);
+}
+
 static void usage(int fd){
 	static char u[] =
 		"Usage: jsb [options] < input > output\n"
@@ -156,30 +1546,55 @@ static void usage(int fd){
 		"	-l  process concatenated json / binary records\n"
 		"	-a  force ascii output for binary -> json\n"
 		"	-t  log timing information to stderr\n"
+		"	-T  log phase times and hardware counters per byte\n";
+	static char v[] =
+		"	-i  convert json -> binary in place (reads all input into memory)\n"
+		"	-u  use io_uring for i/o when available\n"
+		"	-p  read, convert, and write on separate threads with N buffers each\n"
+		"	-x  record table file for binary input (built or reused)\n"
+		"	-g  convert only records I[,N] of binary input (default N = 1)\n"
+		"	-j  convert binary -> json lines (or aggregate) on N threads\n";
+	static char w[] =
+		"	-A  print count/sum/min/max of the numbers at a path (e.g. .bytes) across records\n"
+		"	-f  write out (or with -A, only take) records where PATH OP VALUE holds, with OP\n"
+		"	    one of == != < <= > >=, or where PATH alone is present (repeatable, up to 16)\n"
+		"	-k  with -f, write records in the same format as the input, rather than converted\n"
 		"	-h  this help\n";
 	fdwrite(fd, u, sizeof(u) - 1);
+	fdwrite(fd, v, sizeof(v) - 1);
+	fdwrite(fd, w, sizeof(w) - 1);
 	exit(1);
 }
 
 int main(int argc, char **argv){
 	int r, ch, ret = 1;
 	uint8_t *dst = NULL;
-	size_t dstlen = 0, rlen = 0, wlen = 0, rv;
+	size_t dstlen = 0, rlen = 0, wlen = 0, rv, srclen = 0;
 	ssize_t len;
 	int ifd = fileno(stdin);
 	int ofd = fileno(stdout);
 	int ufd = fileno(stderr);
 	uint8_t *src;
-	int emit = 1, stream = 0, timeit = 0;
+	int emit = 1, stream = 0, timeit = 0, inplace = 0, uring = 0;
+	unsigned pipeline = 0, jobs = 0;
+	const char *xpath = NULL;
+	char *apath = NULL;
+	jsb_pred_t *pred = NULL, *tp;
+	size_t npred = 0, k;
+	query_t q;
+	char *e;
+	int get = 0, keep = 0;
+	size_t first = 0, count = 0, start, nrec, *ends;
 	uint32_t flags = 0;
 	size_t maxdepth = 64;
 	size_t jsz;
 	int eof = 0;
 	block_t bk;
-	clock_t t0, t1;
+	sink_t sk;
+	clock_t t0;
 	jsb_t *jsb;
 	do{
-		switch(ch = getopt(argc, argv, "hsvaltr:w:m:")){
+		switch(ch = getopt(argc, argv, "hsvaltTiukp:r:w:m:x:g:j:A:f:")){
 			case -1:  break;
 			case 's': stream = 1; break;
 			case 'v': emit = 0; break;
@@ -189,6 +1604,25 @@ int main(int argc, char **argv){
 			case 'l': flags |= JSB_LINES; break;
 			case 'a': flags |= JSB_ASCII; break;
 			case 't': timeit = 1; break;
+			case 'T': timeit = 2; break;
+			case 'i': inplace = 1; break;
+			case 'u': uring = 1; break;
+			case 'p': pipeline = strtoul(optarg, NULL, 0); break;
+			case 'x': xpath = optarg; break;
+			case 'j': jobs = strtoul(optarg, NULL, 0); break;
+			case 'A': apath = path_arg(optarg); break;
+			case 'k': keep = 1; break;
+			case 'f':
+				if(JSB_PRED_MAX == npred || !(tp = realloc(pred, (npred + 1) * sizeof(*pred))) || pred_arg(tp + npred, optarg))
+					usage(ufd);
+				pred = tp;
+				npred++;
+				break;
+			case 'g':
+				get = 1;
+				first = strtoul(optarg, &e, 0);
+				count = (',' == *e) ? strtoul(e + 1, NULL, 0) : 1;
+				break;
 			case 'h': ufd = ofd; /* fall through */
 			default:  usage(ufd); break;
 		}
@@ -203,52 +1637,147 @@ int main(int argc, char **argv){
 	jsb = malloc(jsz);
 	assert(jsb);
 
-	dst = malloc(dstlen = wlen);
-	assert(dst);
-
 	t0 = clock();
+	if(2 == timeit)
+		prof_init(&prof);
 
-	src = block_init(&bk, ifd, rlen, stream);
-	assert(MAP_FAILED != src);
+	/* io_uring falls back to threads, or to the plain loop below */
+	if(!inplace && !xpath && !get && !apath && !npred && jobs < 2 && (uring || pipeline)){
+		r = -1;
+#if URING
+		if(uring)
+			r = uring_run(ifd, ofd, jsb, jsz, flags, emit, rlen, wlen);
+#endif
+		if(r < 0 && pipeline)
+			r = pipe_run(ifd, ofd, jsb, jsz, flags, emit, pipeline, rlen, wlen);
+		if(r >= 0){
+			if(!r)
+				ret = close(ofd);
+			if(!ret)
+				timing(timeit, t0, jsb->total_in);
+			free(jsb);
+			return ret;
+		}
+	}
 
-	len = block_next(&bk);
+	if(inplace){
+		src = slurp(ifd, &srclen, &dstlen);
+		assert(src);
+		len = srclen;
+		eof = 1;
+	}else{
+		src = block_init(&bk, ifd, rlen, stream);
+		assert(MAP_FAILED != src);
+		len = block_next(&bk);
+	}
 
-	switch(*src){
-		case JSB_NULL:
-		case JSB_TRUE:
-		case JSB_FALSE:
-		case JSB_NUM:
-		case JSB_STR:
-		case JSB_OBJ:
-		case JSB_ARR:
-			flags |= JSB_REVERSE;
-			/* fall through */
-		default:
-			break;
-		case 0xc0:
-		case 0xc1:
-		case JSB_OBJ_END:
-		case JSB_ARR_END:
-		case JSB_DOC_END:
+	if(!sniff(*src, &flags))
+		goto done;
+
+	/* record tables need all of the binary at hand, and -g then converts a slice of it */
+	if(xpath || get){
+		if(inplace || !(flags & JSB_REVERSE) || bk.state)
+			goto done;
+		ends = records(src, len, xpath, &nrec);
+		if(!ends)
+			goto done;
+		if(!get){
+			free(ends);
+			ret = close(ofd);
+			goto done;
+		}
+		if(first > nrec)
+			first = nrec;
+		if(count > nrec - first)
+			count = nrec - first;
+		start = first ? ends[first - 1] : 0;
+		len = (count ? ends[first + count - 1] : start) - start;
+		src += start;
+		free(ends);
+		flags |= JSB_LINES;
+		eof = 1;
+		if(!len){
+			/* past the last record */
+			ret = close(ofd);
+			goto done;
+		}
+	}
+
+	/* aggregates and filters stream over binary, converting JSON input on the way */
+	if(apath || npred){
+		if(inplace)
+			goto done;
+		memset(&q, 0, sizeof(q));
+		q.path = apath;
+		q.pred = pred;
+		q.npred = npred;
+		jsb_pred_compile(&q.filter, pred, npred);
+		q.jobs = jobs ? jobs : 1;
+		q.ofd = emit ? ofd : -1;
+		q.jsz = jsz;
+		/* matching records go out as jsb would convert them, unless -k keeps their format */
+		if((flags & JSB_REVERSE) ? !keep : keep)
+			q.oflags = JSB_REVERSE | JSB_LINES | (flags & JSB_ASCII);
+		if(flags & JSB_REVERSE)
+			r = each_run(&bk, src, len, qry_run, &q);
+		else
+			r = json_runs(jsb, jsz, &bk, src, len, flags, wlen, qry_run, &q);
+		if(!r && (!apath || !agg_print(ofd, &q))){
+			ret = close(ofd);
+			timing(timeit, t0, (flags & JSB_REVERSE) ? q.bytes : jsb->total_in);
+		}
+		goto done;
+	}
+
+	if(jobs > 1 && !inplace && !bk.state && (flags & JSB_REVERSE) && (flags & JSB_LINES)){
+		if(!par_run(src, len, emit ? ofd : -1, jsz, flags, emit, jobs, rlen)){
+			ret = close(ofd);
+			timing(timeit, t0, len);
+		}
+		goto done;
+	}
+
+	if(inplace && !(flags & JSB_REVERSE)){
+		/* output overwrites input as it goes */
+		jsb_init(jsb, flags | JSB_INPLACE | JSB_EOF, jsz);
+		jsb->next_in = jsb->next_out = src;
+		jsb->avail_in = srclen;
+		jsb->avail_out = dstlen;
+		rv = parse(jsb);
+		if(JSB_DONE != rv || jsb->avail_in)
 			goto done;
+		if(emit){
+			r = fdwrite(ofd, src, jsb->total_out);
+			assert(0 == r);
+		}
+		ret = close(ofd);
+		timing(timeit, t0, srclen);
+		goto done;
 	}
 
+	/* size a mapped output file from the input when all of it is at hand */
+	dstlen = wlen;
+	if(eof || !bk.state){
+		if(!(flags & JSB_REVERSE))
+			dstlen = (flags & JSB_LINES) ? 2 * len + 2 : len + 2;
+		else
+			dstlen = len + len / 2 + 2;
+	}
+	dst = sink_init(&sk, emit ? ofd : -1, dstlen, wlen);
+	assert(dst);
+
 	jsb_init(jsb, flags, jsz);
-	jsb->avail_out = dstlen;
+	if(eof)
+		jsb_eof(jsb);
+	jsb->avail_out = sk.size;
 	jsb->next_out = dst;
 	jsb->avail_in = len;
 	jsb->next_in = src;
 
-	rv = jsb_update(jsb);
+	rv = parse(jsb);
 	while(JSB_OK == rv){
-		if(!jsb->avail_out){
-			if(emit){
-				r = fdwrite(ofd, dst, jsb->next_out - dst);
-				assert(0 == r);
-			}
-			jsb->avail_out = dstlen;
-			jsb->next_out = dst;
-		}
+		if(!jsb->avail_out && sink_next(&sk, jsb))
+			break;
 		if(!jsb->avail_in && !eof){
 			jsb->next_in = src;
 			jsb->avail_in = block_next(&bk);
@@ -257,25 +1786,33 @@ int main(int argc, char **argv){
 				eof = 1;
 			}
 		}
-		rv = jsb_update(jsb);
+		rv = parse(jsb);
 	}
-	if(JSB_ERROR == rv || jsb->avail_in)
+	/* parse errors and output errors (a full disk, say) both exit 1 */
+	if(JSB_OK == rv || JSB_ERROR == rv || jsb->avail_in){
+		sink_fini(&sk, jsb, 1);
 		goto done;
-	if(emit){
-		r = fdwrite(ofd, dst, jsb->next_out - dst);
-		assert(0 == r);
-		if((flags & JSB_REVERSE) && !(flags & JSB_LINES)){
-			r = fdwrite(ofd, "\n", 1);
-			assert(0 == r);
+	}
+	if((flags & JSB_REVERSE) && !(flags & JSB_LINES)){
+		if(!jsb->avail_out && sink_next(&sk, jsb)){
+			sink_fini(&sk, jsb, 1);
+			goto done;
 		}
+		*jsb->next_out++ = '\n';
+		jsb->avail_out--;
 	}
+	if(sink_fini(&sk, jsb, 0))
+		goto done;
 	ret = close(ofd);
-	t1 = clock();
-	if(timeit)
-		fprintf(stderr, "%.3f mb/sec\n", jsb->total_in * (CLOCKS_PER_SEC / 1048576.0) / (t1 - t0));
+	timing(timeit, t0, jsb->total_in);
 done:
-	block_fini(&bk);
-	free(dst);
+	if(inplace)
+		free(src);
+	else
+		block_fini(&bk);
+	for(k = 0; k < npred; k++)
+		free((void *)pred[k].base);
+	free(pred);
 	free(jsb);
 	return ret;
 }